@@ -0,0 +1,250 @@
+#include "AsyncClient.h"
+#include "NetIo.h"
+
+#include <algorithm>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+AsyncClient::AsyncClient(const std::vector<sockaddr_in>& server_addrs, const size_t window, const size_t virtual_nodes)
+    : in_flight_per_socket(server_addrs.size(), 0), keys_by_server(server_addrs.size()), num_servers(server_addrs.size()),
+      window(std::max<size_t>(window, 1)), gen(std::random_device{}())
+{
+    // Same key space as Client::run; each socket only ever sends the keys the ring gives its server
+    HashRing ring(virtual_nodes);
+    for(size_t i = 0; i < num_servers; i++){
+        ring.add_node(static_cast<uint32_t>(i), endpoint_name(server_addrs[i]));
+    }
+    for(int key = 0; key <= 10000; key++){
+        keys_by_server[ring.owner(std::to_string(key))].push_back(key);
+    }
+
+    epoll_fd = epoll_create1(0);
+    if(epoll_fd == -1){
+        exit(EXIT_FAILURE);
+    }
+
+    for(size_t i = 0; i < num_servers; i++){
+        const int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if(fd == -1){
+            exit(EXIT_FAILURE);
+        }
+
+        // Connected sockets let the kernel drop datagrams from anyone but this server
+        if(connect(fd, reinterpret_cast<const sockaddr*>(&server_addrs[i]), sizeof(server_addrs[i])) == -1){
+            close(fd);
+            exit(EXIT_FAILURE);
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = i;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        sockets.push_back(fd);
+    }
+}
+
+AsyncClient::~AsyncClient()
+{
+    for(const int fd : sockets){
+        close(fd);
+    }
+    close(epoll_fd);
+}
+
+std::string AsyncClient::next_request(const size_t server, const uint64_t request_id)
+{
+    const std::vector<int>& keys = keys_by_server[server];
+    std::uniform_int_distribution op_dist(0, 1);
+    std::uniform_int_distribution<size_t> key_dist(0, keys.size() - 1);
+    std::uniform_int_distribution value_dist(0, 10000);
+
+    const std::string key = std::to_string(keys[key_dist(gen)]);
+
+    protocol::Header header;
+    header.opcode = op_dist(gen) == 0 ? PUT : GET;
+    header.request_id = request_id;
+
+    std::string request;
+    protocol::encode(request, header, {}, key, header.opcode == PUT ? std::to_string(value_dist(gen)) : "");
+    return request;
+}
+
+void AsyncClient::fill_window(const size_t server)
+{
+    const size_t free_slots = window - in_flight_per_socket[server];
+    if(free_slots == 0 || keys_by_server[server].empty()){
+        return;
+    }
+
+    std::vector<uint64_t> ids;
+    ids.reserve(free_slots);
+    const auto now = Clock::now();
+    const auto deadline = now + RESPONSE_TIMEOUT;
+
+    for(size_t i = 0; i < free_slots; i++){
+        const uint64_t id = next_request_id++;
+        InFlight& entry = in_flight[id];
+        entry.server = server;
+        entry.request = next_request(server, id);
+        entry.sent_at = now;
+        entry.deadline = deadline;
+        ids.push_back(id);
+        timers.push_back(Timer{deadline, id});
+    }
+    in_flight_per_socket[server] += free_slots;
+
+    // Built after all inserts so no rehash can move the request buffers under us
+    std::vector<iovec> iovecs(ids.size());
+    std::vector<mmsghdr> msgs(ids.size());
+    for(size_t i = 0; i < ids.size(); i++){
+        std::string& request = in_flight[ids[i]].request;
+        iovecs[i].iov_base = request.data();
+        iovecs[i].iov_len = request.size();
+        msgs[i].msg_hdr = msghdr{};
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // Anything the kernel does not take is picked up by the retry timer
+    size_t sent = 0;
+    while(sent < msgs.size()){
+        const int result = sendmmsg(sockets[server], msgs.data() + sent, static_cast<unsigned int>(msgs.size() - sent), 0);
+        if(result <= 0){
+            break;
+        }
+        sent += static_cast<size_t>(result);
+    }
+}
+
+void AsyncClient::drain_socket(const size_t server)
+{
+    constexpr size_t BATCH_SIZE = 32;
+    std::array<std::array<char, 1024>, BATCH_SIZE> buffers;
+    std::array<iovec, BATCH_SIZE> iovecs{};
+    std::array<mmsghdr, BATCH_SIZE> msgs{};
+
+    for(size_t i = 0; i < BATCH_SIZE; i++){
+        iovecs[i].iov_base = buffers[i].data();
+        iovecs[i].iov_len = buffers[i].size();
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while(true){
+        const int received = recvmmsg(sockets[server], msgs.data(), BATCH_SIZE, MSG_DONTWAIT, nullptr);
+        if(received <= 0){
+            return;
+        }
+
+        const auto now = Clock::now();
+        for(int i = 0; i < received; i++){
+            protocol::Message message;
+            const std::string_view datagram(buffers[i].data(), msgs[i].msg_len);
+            if(protocol::decode(datagram, message) == -1){
+                stale_count.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            const auto it = in_flight.find(message.header.request_id);
+            if(it == in_flight.end() || it->second.server != server){
+                // Duplicate reply to a retried request, or one we already gave up on
+                stale_count.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            // Any reply settles the request, but only a served one counts towards throughput and latency
+            switch(message.header.status){
+                case protocol::OK:
+                case protocol::NOT_FOUND:
+                {
+                    const auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(now - it->second.sent_at);
+                    total_latency_ns.fetch_add(static_cast<uint64_t>(latency.count()), std::memory_order_relaxed);
+                    successful_ops.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                }
+                case protocol::NOT_STORED:
+                    not_stored_count.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                case protocol::MOVED:
+                    redirect_count.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                default:
+                    error_count.fetch_add(1, std::memory_order_relaxed);
+                    break;
+            }
+            in_flight.erase(it);
+            in_flight_per_socket[server]--;
+        }
+
+        if(static_cast<size_t>(received) < BATCH_SIZE){
+            return;
+        }
+    }
+}
+
+void AsyncClient::expire_timers()
+{
+    const auto now = Clock::now();
+
+    while(!timers.empty() && timers.front().deadline <= now){
+        const Timer timer = timers.front();
+        timers.pop_front();
+
+        const auto it = in_flight.find(timer.request_id);
+        if(it == in_flight.end() || it->second.deadline != timer.deadline){
+            continue;
+        }
+
+        InFlight& entry = it->second;
+        if(entry.attempts < MAX_ATTEMPTS && running.load(std::memory_order_relaxed)){
+            entry.attempts++;
+            entry.deadline = now + RESPONSE_TIMEOUT;
+            send(sockets[entry.server], entry.request.data(), entry.request.size(), 0);
+            timers.push_back(Timer{entry.deadline, timer.request_id});
+            continue;
+        }
+
+        if(running.load(std::memory_order_relaxed)){
+            timeout_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        in_flight_per_socket[entry.server]--;
+        in_flight.erase(it);
+    }
+}
+
+int AsyncClient::next_timeout_ms() const
+{
+    constexpr int IDLE_TIMEOUT_MS = 50;  // Bounds how long stop() takes to notice
+    if(timers.empty()){
+        return IDLE_TIMEOUT_MS;
+    }
+
+    const auto remaining = timers.front().deadline - Clock::now();
+    const auto ms = std::chrono::ceil<std::chrono::milliseconds>(remaining).count();
+    return static_cast<int>(std::clamp<long long>(ms, 0, IDLE_TIMEOUT_MS));
+}
+
+void AsyncClient::run()
+{
+    constexpr int MAX_EVENTS = 16;
+    std::array<epoll_event, MAX_EVENTS> events{};
+
+    for(size_t i = 0; i < num_servers; i++){
+        fill_window(i);
+    }
+
+    while(running.load(std::memory_order_relaxed)){
+        const int ready = epoll_wait(epoll_fd, events.data(), MAX_EVENTS, next_timeout_ms());
+
+        for(int i = 0; i < ready; i++){
+            drain_socket(static_cast<size_t>(events[i].data.u64));
+        }
+
+        expire_timers();
+
+        for(size_t i = 0; i < num_servers; i++){
+            fill_window(i);
+        }
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef DISTIBUTED_HASH_TABLE_ASYNCCLIENT_H
+#define DISTIBUTED_HASH_TABLE_ASYNCCLIENT_H
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+
+#include "ds/HashMap/phmap.hpp"
+#include "HashRing.h"
+#include "Protocol.h"
+#include "Request.h"
+
+// Open-loop load generator: keeps up to `window` requests in flight on every server socket
+// and drives all of them from one epoll loop on the calling thread.
+class AsyncClient
+{
+    using Clock = std::chrono::steady_clock;
+    static constexpr std::chrono::milliseconds RESPONSE_TIMEOUT{15};
+    static constexpr int MAX_ATTEMPTS = 3;
+
+    struct InFlight
+    {
+        size_t server = 0;
+        std::string request;
+        Clock::time_point sent_at;
+        Clock::time_point deadline;
+        int attempts = 1;
+    };
+
+    // Deadlines are pushed in non-decreasing order, so a FIFO is a valid timer queue;
+    // entries whose request already completed (or was re-armed) are skipped lazily
+    struct Timer
+    {
+        Clock::time_point deadline;
+        uint64_t request_id;
+    };
+
+    std::vector<int> sockets;  // One connected UDP socket per server
+    std::vector<size_t> in_flight_per_socket;
+    std::vector<std::vector<int>> keys_by_server;  // Benchmark key space split by ring owner
+    size_t num_servers;
+    size_t window;
+    int epoll_fd = -1;
+    uint64_t next_request_id = 1;
+
+    gtl::flat_hash_map<uint64_t, InFlight> in_flight;
+    std::deque<Timer> timers;
+
+    std::mt19937 gen;
+    std::atomic<bool> running{true};
+    std::atomic<uint64_t> successful_ops{0};    // OK and NOT_FOUND replies
+    std::atomic<uint64_t> not_stored_count{0};  // PUTs of keys that already exist
+    std::atomic<uint64_t> redirect_count{0};    // MOVED replies; the key space is fixed, so they are not followed
+    std::atomic<uint64_t> error_count{0};       // BAD_REQUEST, TRUNCATED and anything unknown
+    std::atomic<uint64_t> timeout_count{0};
+    std::atomic<uint64_t> stale_count{0};
+    std::atomic<uint64_t> total_latency_ns{0};
+
+    void fill_window(size_t server);
+    void drain_socket(size_t server);
+    void expire_timers();
+    int next_timeout_ms() const;
+    std::string next_request(size_t server, uint64_t request_id);
+
+public:
+    AsyncClient(const std::vector<sockaddr_in> &server_addrs, size_t window,
+                size_t virtual_nodes = HashRing::DEFAULT_VNODES);
+    ~AsyncClient();
+    AsyncClient(const AsyncClient&) = delete;
+    AsyncClient& operator=(const AsyncClient&) = delete;
+
+    void run();
+    void stop() { running.store(false); }
+    uint64_t get_successful_ops() const { return successful_ops.load(); }
+    uint64_t get_not_stored_count() const { return not_stored_count.load(); }
+    uint64_t get_redirect_count() const { return redirect_count.load(); }
+    uint64_t get_error_count() const { return error_count.load(); }
+    uint64_t get_timeout_count() const { return timeout_count.load(); }
+    uint64_t get_stale_count() const { return stale_count.load(); }
+    uint64_t get_total_latency_ns() const { return total_latency_ns.load(); }
+};
+
+#endif //DISTIBUTED_HASH_TABLE_ASYNCCLIENT_H
@@ -1,24 +1,31 @@
 #include "Client.h"
+#include "NetIo.h"
 
-#include <chrono>
+#include <algorithm>
+#include <cmath>
 #include <random>
-#include <thread>
+#include <poll.h>
 #include <unistd.h>
 #include <sys/socket.h>
 
-Client::Client(const std::array<sockaddr_in, 3>& server_addrs, const size_t num_servers, const uint16_t client_port) 
-    : server_addrs(server_addrs), num_servers(num_servers)
+Client::Client(std::vector<sockaddr_in> server_addrs, const uint16_t client_port, const WireFormat format,
+               const size_t virtual_nodes)
+    : server_addrs(std::move(server_addrs)), num_servers(this->server_addrs.size()), ring(virtual_nodes), format(format),
+      client_tag(std::random_device{}() & VERSION_TAG_MASK), receive_buffer(protocol::MAX_RESPONSE_SIZE)
 {
+    for(size_t i = 0; i < num_servers; i++){
+        ring.add_node(static_cast<uint32_t>(i), endpoint_name(this->server_addrs[i]));
+    }
+    in_ring.assign(num_servers, true);
+    rtt.resize(num_servers);
+    retry_jitter.seed(std::random_device{}());
+    spread_pick.seed(std::random_device{}());
+
     socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
     if(socket_fd == -1){
         exit(EXIT_FAILURE);
     }
 
-    timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = 15000;  // 15ms timeout
-    setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-
     if (client_port != 0) {
         sockaddr_in client_addr{};
         client_addr.sin_family = AF_INET;
@@ -34,62 +41,1195 @@ Client::Client(const std::array<sockaddr_in, 3>& server_addrs, const size_t num_
 
 Client::~Client()
 {
+    stop();
+    if(dispatcher.joinable()){
+        dispatcher.join();
+    }
+
+    // Anything submitted while stop() was racing the dispatcher still gets its answer
+    AsyncOperation leftover;
+    while(async_queue.try_dequeue(leftover)){
+        leftover.callback(Result{});
+    }
     close(socket_fd);
 }
 
-int Client::try_send_request(const Request& request, const std::string& key, const std::optional<std::string>& value) const
+size_t Client::route(const std::string& key) const
 {
-    // Should be changed if data type is not integer strings
-    const int idx = std::stoi(key) % num_servers;
-    sockaddr_in addr = server_addrs[idx];
-    const std::string request_str = serialize_request(request, key, value);
-    if(const ssize_t bytes_sent = sendto(socket_fd, request_str.data(), request_str.size(), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)); bytes_sent == -1){
-        return -1;
-    }
-    return 0;
+    std::shared_lock lock(ring_mutex);
+    return ring.owner(key);
 }
 
-std::any Client::receive_response()
+void Client::learn(const std::string_view endpoint)
 {
-    std::array<char, 1024> buffer;
+    // Called with io_mutex held, so nothing is sending through server_addrs while it grows.
+    // A known server is left alone even if it is out of the ring: the membership says it is dead.
     sockaddr_in addr{};
-    socklen_t addr_len = sizeof(addr);
-    const ssize_t bytes_received = recvfrom(socket_fd, buffer.data(), buffer.size(), 0, reinterpret_cast<sockaddr*>(&addr), &addr_len);
-    if(bytes_received == -1){
-        return std::nullopt;
+    if(parse_endpoint(endpoint, 0, addr) == -1 || addr.sin_port == 0 || find_server(addr) != SIZE_MAX){
+        return;
+    }
+
+    std::unique_lock lock(ring_mutex);
+    add_server(addr);
+}
+
+size_t Client::find_server(const sockaddr_in& addr) const
+{
+    for(size_t i = 0; i < server_addrs.size(); i++){
+        if(server_addrs[i].sin_addr.s_addr == addr.sin_addr.s_addr && server_addrs[i].sin_port == addr.sin_port){
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+void Client::add_server(const sockaddr_in& addr)
+{
+    // Called with ring_mutex held exclusively
+    server_addrs.push_back(addr);
+    in_ring.push_back(true);
+    rtt.emplace_back();
+    ring.add_node(static_cast<uint32_t>(num_servers), endpoint_name(addr));
+    num_servers++;
+}
+
+bool Client::refresh_membership()
+{
+    // Called with io_mutex held. Servers are asked in turn, so a dead one only costs one timeout
+    for(int attempt = 0; attempt < MAX_ATTEMPTS && running.load(std::memory_order_relaxed); attempt++){
+        size_t server = SIZE_MAX;
+        for(size_t n = 0; n < num_servers && server == SIZE_MAX; n++){
+            const size_t candidate = (refresh_cursor + n) % num_servers;
+            if(in_ring[candidate]){
+                server = candidate;
+            }
+        }
+        if(server == SIZE_MAX){
+            return false;
+        }
+        refresh_cursor = server + 1;
+
+        protocol::Header header;
+        header.opcode = MEMBERS;
+        header.request_id = next_request_id++;
+        std::string request;
+        protocol::encode(request, header, {}, {}, {});
+        const sockaddr_in& addr = server_addrs[server];
+        const auto sent_at = std::chrono::steady_clock::now();
+        sendto(socket_fd, request.data(), request.size(), 0, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+
+        const auto deadline = sent_at + timeout_for(server);
+        while(wait_readable(deadline)){
+            const ssize_t bytes_received = recv(socket_fd, receive_buffer.data(), receive_buffer.size(), MSG_DONTWAIT);
+            if(bytes_received == -1){
+                continue;
+            }
+
+            protocol::Message message;
+            const std::string_view datagram(receive_buffer.data(), static_cast<size_t>(bytes_received));
+            const bool decoded = protocol::decode(datagram, message) == 0;
+            if(!decoded || message.header.request_id != header.request_id){
+                if(!decoded || message.header.request_id != 0){
+                    stale_count.fetch_add(1, std::memory_order_relaxed);  // Late replies, not read repair acks
+                }
+                continue;
+            }
+            record_rtt(server, std::chrono::steady_clock::now() - sent_at);
+
+            // BAD_REQUEST: the servers run without gossip, so there is nothing to follow
+            uint64_t version = 0;
+            std::vector<std::string_view> names;
+            if(message.header.status != protocol::OK || protocol::unpack_version(message.extras, version) == -1 ||
+               protocol::unpack_keys(message.value, names) == -1){
+                return false;
+            }
+            if(version != membership_version){
+                apply_membership(names);
+                membership_version = version;
+                membership_changes.fetch_add(1, std::memory_order_relaxed);
+            }
+            return true;
+        }
+        back_off(server);
+    }
+    return false;
+}
+
+void Client::apply_membership(const std::vector<std::string_view>& names)
+{
+    // An empty list can only come from a confused server; routing nowhere would not help
+    if(names.empty()){
+        return;
+    }
+
+    std::vector<bool> alive(num_servers, false);
+    std::vector<sockaddr_in> joined;
+    for(const std::string_view name : names){
+        sockaddr_in addr{};
+        if(parse_endpoint(name, 0, addr) == -1 || addr.sin_port == 0){
+            continue;
+        }
+        const size_t server = find_server(addr);
+        if(server == SIZE_MAX){
+            joined.push_back(addr);
+        } else {
+            alive[server] = true;
+        }
+    }
+
+    std::unique_lock lock(ring_mutex);
+    for(size_t i = 0; i < alive.size(); i++){
+        if(alive[i] == in_ring[i]){
+            continue;
+        }
+        if(alive[i]){
+            ring.add_node(static_cast<uint32_t>(i), endpoint_name(server_addrs[i]));
+        } else {
+            ring.remove_node(static_cast<uint32_t>(i));
+        }
+        in_ring[i] = alive[i];
+    }
+    for(const sockaddr_in& addr : joined){
+        add_server(addr);
+    }
+}
+
+size_t Client::reroute(const Operation& operation, const size_t server) const
+{
+    // Called with io_mutex held. Packed requests have no key of their own; execute_packed reroutes their entries
+    return in_ring[server] || operation.key.empty() ? server : ring.owner(operation.key);
+}
+
+bool Client::routable(const size_t server) const
+{
+    std::shared_lock lock(ring_mutex);
+    return in_ring[server];
+}
+
+const sockaddr_in& Client::target(const Request request, const size_t server) const
+{
+    const bool read = request == GET || request == MGET;
+    return read && server < read_addrs.size() ? read_addrs[server] : server_addrs[server];
+}
+
+bool Client::set_quorum(const size_t replicas, const size_t reads, const size_t writes)
+{
+    if(format != WireFormat::BINARY || near_cache_capacity > 0 || replicas == 0 || replicas > num_servers ||
+       reads == 0 || reads > replicas || writes == 0 || writes > replicas){
+        return false;
+    }
+    quorum = true;
+    replication_factor = replicas;
+    read_quorum = reads;
+    write_quorum = writes;
+    return true;
+}
+
+bool Client::set_hedging(const double budget)
+{
+    if(!quorum || replication_factor <= read_quorum || budget <= 0 || budget > 1){
+        return false;
+    }
+    hedge_budget = budget;
+    return true;
+}
+
+void Client::set_read_servers(std::vector<sockaddr_in> tails)
+{
+    if(tails.size() == num_servers){
+        read_addrs = std::move(tails);
+    }
+}
+
+bool Client::set_near_cache(const size_t capacity)
+{
+    if(format != WireFormat::BINARY || quorum || !read_addrs.empty() || capacity == 0){
+        return false;
+    }
+    near_cache_capacity = capacity;
+    near_cache.reserve(capacity);
+    return true;
+}
+
+bool Client::set_membership_refresh(const std::chrono::milliseconds interval)
+{
+    if(format != WireFormat::BINARY || !read_addrs.empty() || interval.count() <= 0){
+        return false;
+    }
+    membership_refresh = interval;
+    return true;
+}
+
+Client::Operation Client::make_operation(const Request request, const std::string& key, const std::string& value) const
+{
+    return Operation{request, key, value, route(key)};
+}
+
+std::string Client::serialize_request(const Operation& operation, const uint64_t request_id) const
+{
+    if(format == WireFormat::BINARY){
+        protocol::Header header;
+        header.opcode = operation.request;
+        header.flags = operation.request == GET && near_cache_capacity > 0 ? protocol::LEASE : 0;
+        header.request_id = request_id;
+        std::string request_str;
+        protocol::encode(request_str, header, {}, operation.key, operation.request == GET ? "" : operation.value);
+        return request_str;
+    }
+
+    std::string request_str = operation.request == PUT ? "PUT" : "GET";
+    request_str += ":" + operation.key;
+    if(operation.request == PUT){
+        request_str += ":" + operation.value;
+    }
+    return request_str;
+}
+
+Result Client::make_result(const protocol::Status status, const std::string_view value)
+{
+    Result result;
+    switch(status){
+        case protocol::OK:
+            result.code = ResultCode::OK;
+            result.value = std::string(value);
+            break;
+        case protocol::NOT_FOUND:
+            result.code = ResultCode::NOT_FOUND;
+            break;
+        case protocol::NOT_STORED:
+            result.code = ResultCode::NOT_STORED;
+            break;
+        default:
+            result.code = ResultCode::REJECTED;
+            break;
+    }
+    return result;
+}
+
+void Client::count_result(const Result& result)
+{
+    switch(result.code){
+        case ResultCode::OK:
+        case ResultCode::NOT_FOUND:
+            successful_ops.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case ResultCode::NOT_STORED:
+            not_stored_count.fetch_add(1, std::memory_order_relaxed);
+            break;
+        default:
+            error_count.fetch_add(1, std::memory_order_relaxed);
+            break;
+    }
+}
+
+Result Client::parse_text_response(const Operation& operation, const std::string_view datagram)
+{
+    // Legacy replies cannot tell a missing key from an empty value
+    Result result;
+    if(operation.request == PUT){
+        result.code = datagram == "TRUE" ? ResultCode::OK : ResultCode::NOT_STORED;
+    } else if(datagram.empty()){
+        result.code = ResultCode::NOT_FOUND;
+    } else {
+        result.code = ResultCode::OK;
+        result.value = std::string(datagram);
+    }
+    return result;
+}
+
+bool Client::wait_readable(const std::chrono::steady_clock::time_point deadline) const
+{
+    const auto remaining = deadline - std::chrono::steady_clock::now();
+    if(remaining <= std::chrono::nanoseconds::zero()){
+        return false;
+    }
+    // ppoll rejects a tv_nsec of a second or more, so whole seconds go in tv_sec
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+    const timespec timeout{static_cast<time_t>(ns / 1'000'000'000), static_cast<long>(ns % 1'000'000'000)};
+    pollfd pfd{socket_fd, POLLIN, 0};
+    return ppoll(&pfd, 1, &timeout, nullptr) > 0;
+}
+
+std::chrono::microseconds Client::timeout_for(const size_t server) const
+{
+    const RttEstimate& estimate = rtt[server];
+    const std::chrono::microseconds base = estimate.sampled ? estimate.srtt + 4 * estimate.rttvar : INITIAL_TIMEOUT;
+    return std::min(std::max(base, MIN_TIMEOUT) * (1 << estimate.backoff), MAX_TIMEOUT);
+}
+
+void Client::record_rtt(const size_t server, const std::chrono::steady_clock::duration sample)
+{
+    // Callers only sample replies to requests sent once (Karn), since a retried request's reply
+    // could belong to either send
+    const auto measured = std::chrono::duration_cast<std::chrono::microseconds>(sample);
+    RttEstimate& estimate = rtt[server];
+    if(!estimate.sampled){
+        estimate.srtt = measured;
+        estimate.rttvar = measured / 2;
+        estimate.sampled = true;
+    } else {
+        const auto error = estimate.srtt > measured ? estimate.srtt - measured : measured - estimate.srtt;
+        estimate.rttvar = (3 * estimate.rttvar + error) / 4;
+        estimate.srtt = (7 * estimate.srtt + measured) / 8;
     }
-    return std::any(std::string(buffer.data(), bytes_received));
+    estimate.backoff = 0;
+
+    estimate.recent[estimate.samples % RTT_WINDOW] = static_cast<uint32_t>(std::min<int64_t>(measured.count(), UINT32_MAX));
+    estimate.samples++;
+    if(estimate.samples >= MIN_HEDGE_SAMPLES && estimate.samples % 16 == 0){
+        std::array<uint32_t, RTT_WINDOW> sorted = estimate.recent;
+        const size_t window = std::min(estimate.samples, RTT_WINDOW);
+        const auto percentile = sorted.begin() + static_cast<std::ptrdiff_t>(window * 95 / 100);
+        std::nth_element(sorted.begin(), percentile, sorted.begin() + static_cast<std::ptrdiff_t>(window));
+        estimate.p95 = std::chrono::microseconds(*percentile);
+    }
+}
+
+void Client::back_off(const size_t server)
+{
+    RttEstimate& estimate = rtt[server];
+    estimate.backoff = std::min(estimate.backoff + 1, MAX_BACKOFF);
 }
 
-std::any Client::send_request(const Request& request, const std::string& key, const std::optional<std::string>& value)
+void Client::pause_before_retry(const int attempt)
 {
-    constexpr int num_retries = 3;
-    for(int i = 0; i < num_retries && running.load(std::memory_order_relaxed); i++){
-        if(try_send_request(request, key, value) == 0){
-            if(std::any response = receive_response(); response.has_value()){
-                successful_ops.fetch_add(1, std::memory_order_relaxed);
-                return response;
+    std::uniform_int_distribution<int64_t> pause(0, (RETRY_PAUSE * (1 << attempt)).count());
+    std::this_thread::sleep_for(std::chrono::microseconds(pause(retry_jitter)));
+}
+
+void Client::execute_binary(const Operation* operations, const size_t count, Result* results, const int redirects)
+{
+    // Ids are contiguous, so a reply maps straight to its slot in the batch
+    const uint64_t base_id = next_request_id;
+    next_request_id += count;
+
+    // Serialized once so every retry carries the same request id
+    std::vector<std::string> requests(count);
+    for(size_t i = 0; i < count; i++){
+        requests[i] = serialize_request(operations[i], base_id + i);
+    }
+
+    // Operations routed before the last membership refresh may point at a server since found dead
+    std::vector<size_t> servers(count);
+    for(size_t i = 0; i < count; i++){
+        servers[i] = reroute(operations[i], operations[i].server);
+    }
+
+    std::vector<bool> answered(count, false);
+    std::vector<size_t> moved;
+    std::vector<size_t> pending(count);
+    for(size_t i = 0; i < count; i++){
+        pending[i] = i;
+    }
+    std::vector<iovec> iovecs(count);
+    std::vector<mmsghdr> msgs(count);
+    std::vector<size_t> silent;
+    std::chrono::steady_clock::time_point first_sent;  // Leases count from here: no reply can predate it
+
+    for(int attempt = 0; attempt < MAX_ATTEMPTS && !pending.empty() && running.load(std::memory_order_relaxed); attempt++){
+        if(attempt > 0){
+            pause_before_retry(attempt);
+        }
+
+        // The batch waits as long as its slowest server is expected to take
+        std::chrono::microseconds timeout{0};
+        for(size_t i = 0; i < pending.size(); i++){
+            timeout = std::max(timeout, timeout_for(servers[pending[i]]));
+            std::string& request = requests[pending[i]];
+            iovecs[i].iov_base = request.data();
+            iovecs[i].iov_len = request.size();
+            msgs[i].msg_hdr = msghdr{};
+            msgs[i].msg_hdr.msg_name = const_cast<sockaddr_in*>(&target(operations[pending[i]].request, servers[pending[i]]));
+            msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            msgs[i].msg_hdr.msg_iov = &iovecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        // Whatever the kernel does not take is resent on the next attempt
+        const auto sent_at = std::chrono::steady_clock::now();
+        if(attempt == 0){
+            first_sent = sent_at;
+        }
+        size_t sent = 0;
+        while(sent < pending.size()){
+            const int result = sendmmsg(socket_fd, msgs.data() + sent, static_cast<unsigned int>(pending.size() - sent), 0);
+            if(result <= 0){
+                break;
             }
+            sent += static_cast<size_t>(result);
         }
-        if (i < num_retries - 1) {
-            std::this_thread::sleep_for(std::chrono::microseconds(500));  // 0.5ms between retries
+
+        const auto deadline = sent_at + timeout;
+        size_t outstanding = pending.size();
+        while(outstanding > 0 && wait_readable(deadline)){
+            const ssize_t bytes_received = recv(socket_fd, receive_buffer.data(), receive_buffer.size(), MSG_DONTWAIT);
+            if(bytes_received == -1){
+                continue;
+            }
+
+            protocol::Message message;
+            const std::string_view datagram(receive_buffer.data(), static_cast<size_t>(bytes_received));
+            const bool decoded = protocol::decode(datagram, message) == 0;
+            if(decoded && message.header.request_id == 0){
+                continue;  // Ack of a read repair
+            }
+            if(!decoded || message.header.request_id < base_id ||
+               message.header.request_id - base_id >= count || answered[message.header.request_id - base_id]){
+                // A late reply to an earlier request, a duplicate after a retry, or garbage
+                stale_count.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            const size_t slot = message.header.request_id - base_id;
+            results[slot] = make_result(message.header.status, message.value);
+            if((message.header.flags & protocol::HOT_KEY) != 0){
+                results[slot].hot = true;
+                hot_hints.fetch_add(1, std::memory_order_relaxed);
+            }
+            if((message.header.flags & protocol::SPREAD) != 0 && !quorum && read_addrs.empty()){
+                results[slot].spread = true;
+                spreading.store(true, std::memory_order_relaxed);
+            }
+            uint32_t lease_us = 0;
+            if(message.header.status == protocol::OK && protocol::unpack_lease(message.extras, lease_us) == 0){
+                results[slot].lease_expiry = first_sent + std::chrono::microseconds(lease_us);
+            }
+            answered[slot] = true;
+            outstanding--;
+            if(attempt == 0){
+                record_rtt(servers[slot], std::chrono::steady_clock::now() - sent_at);
+            }
+            // A server added by a live migration is learned from the MOVED reply and joined to the
+            // ring; the request is retried against its new owner below
+            if(message.header.status == protocol::MOVED && redirects < MAX_REDIRECTS){
+                learn(message.value);
+                moved.push_back(slot);
+            } else {
+                count_result(results[slot]);
+            }
+        }
+
+        pending.erase(std::remove_if(pending.begin(), pending.end(), [&](const size_t i) { return answered[i]; }),
+                      pending.end());
+
+        silent.clear();
+        for(const size_t i : pending){
+            silent.push_back(servers[i]);
+        }
+        std::ranges::sort(silent);
+        const auto [first_duplicate, last] = std::ranges::unique(silent);
+        silent.erase(first_duplicate, last);
+        for(const size_t server : silent){
+            back_off(server);
+        }
+
+        // Silence may mean a server died: check the membership early rather than waiting for the
+        // next scheduled refresh, and send what is left to the surviving owners
+        const auto now = std::chrono::steady_clock::now();
+        if(!pending.empty() && membership_refresh.count() > 0 && now >= next_forced_refresh){
+            next_forced_refresh = now + FORCED_REFRESH_INTERVAL;
+            if(refresh_membership()){
+                for(const size_t i : pending){
+                    servers[i] = reroute(operations[i], servers[i]);
+                }
+            }
         }
     }
+
     // Only count as timeout when ALL retries have failed
-    if (running.load(std::memory_order_relaxed)) {
+    if(running.load(std::memory_order_relaxed)){
+        timeout_count.fetch_add(pending.size(), std::memory_order_relaxed);
+    }
+
+    // Keys that changed hands are routed again on the grown ring and sent to their new owner
+    if(!moved.empty()){
+        std::vector<Operation> rerouted;
+        rerouted.reserve(moved.size());
+        for(const size_t slot : moved){
+            rerouted.push_back(operations[slot]);
+            rerouted.back().server = route(rerouted.back().key);
+        }
+        std::vector<Result> rerouted_results(rerouted.size());
+        execute_binary(rerouted.data(), rerouted.size(), rerouted_results.data(), redirects + 1);
+        for(size_t i = 0; i < moved.size(); i++){
+            results[moved[i]] = std::move(rerouted_results[i]);
+        }
+    }
+}
+
+uint64_t Client::next_version()
+{
+    // The clock keeps clients roughly in step for last-writer-wins; bumping past the previous tick
+    // keeps one client's versions strictly increasing, and the tag keeps clients from colliding
+    const uint64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    last_tick = std::max(now, last_tick + 1);
+    return last_tick << VERSION_TAG_BITS | client_tag;
+}
+
+void Client::execute_quorum(const Operation* operations, const size_t count, Result* results)
+{
+    // One request per replica; operation i owns fanouts [first[i], first[i + 1])
+    struct Fanout
+    {
+        size_t operation = 0;
+        uint32_t server = 0;
+        std::string request;
+        bool sent = false;
+        bool hedge = false;  // Sent because the first replicas were slow
+        bool answered = false;
+        protocol::Status status = protocol::OK;
+        uint64_t version = 0;
+        std::string value;
+    };
+
+    const uint64_t base_id = next_request_id;
+    std::vector<Fanout> fanouts;
+    std::vector<size_t> first(count + 1);
+    std::vector<uint32_t> owners;
+    const auto needed = [&](const size_t i) { return operations[i].request == PUT ? write_quorum : read_quorum; };
+    std::vector<bool> unavailable(count, false);
+    size_t unavailable_ops = 0;
+    size_t reached = 0;  // Operations settled: quorum met or unavailable
+    for(size_t i = 0; i < count; i++){
+        const Operation& operation = operations[i];
+        const bool write = operation.request == PUT;
+
+        first[i] = fanouts.size();
+        ring.owners(operation.key, replication_factor, owners);
+        // With dead servers dropped from the ring a key can have fewer live owners than its quorum;
+        // no amount of retrying reaches it, so it fails without sending anything
+        if(owners.size() < needed(i)){
+            unavailable[i] = true;
+            unavailable_ops++;
+            reached++;
+            continue;
+        }
+        const std::string version = write ? protocol::pack_version(next_version()) : std::string{};
+        for(const uint32_t server : owners){
+            Fanout fanout;
+            fanout.operation = i;
+            fanout.server = server;
+            protocol::Header header;
+            header.opcode = write ? VPUT : VGET;
+            header.request_id = base_id + fanouts.size();
+            protocol::encode(fanout.request, header, version, operation.key, write ? operation.value : "");
+            fanouts.push_back(std::move(fanout));
+        }
+    }
+    first[count] = fanouts.size();
+    next_request_id += fanouts.size();
+
+    std::vector<size_t> acks(count, 0);
+    std::vector<size_t> pending;
+    std::vector<iovec> iovecs(fanouts.size());
+    std::vector<mmsghdr> msgs(fanouts.size());
+
+    // With hedging, a read first goes to just enough replicas; the rest are held back for hedges
+    const bool hedging = hedge_budget > 0;
+    const auto held_back = [&](const size_t f) {
+        const size_t i = fanouts[f].operation;
+        return hedging && operations[i].request == GET && f - first[i] >= read_quorum;
+    };
+    if(hedging){
+        for(size_t i = 0; i < count; i++){
+            if(operations[i].request == GET){
+                hedge_tokens = std::min(hedge_tokens + hedge_budget, MAX_HEDGE_BURST);
+            }
+        }
+    }
+
+    for(int attempt = 0; attempt < MAX_ATTEMPTS && reached < count && running.load(std::memory_order_relaxed); attempt++){
+        if(attempt > 0){
+            pause_before_retry(attempt);
+        }
+
+        // Only replicas of operations still short of their quorum are (re)asked
+        pending.clear();
+        for(size_t f = 0; f < fanouts.size(); f++){
+            if(!fanouts[f].answered && acks[fanouts[f].operation] < needed(fanouts[f].operation) &&
+               (attempt > 0 || !held_back(f))){
+                pending.push_back(f);
+            }
+        }
+
+        // Hedge once the slowest first-asked read replica is past its usual (p95) round trip
+        std::chrono::microseconds timeout{0};
+        std::chrono::microseconds hedge_delay{0};
+        bool hedged = !hedging || attempt > 0;
+        for(size_t i = 0; i < pending.size(); i++){
+            Fanout& fanout = fanouts[pending[i]];
+            fanout.sent = true;
+            timeout = std::max(timeout, timeout_for(fanout.server));
+            if(!hedged && operations[fanout.operation].request == GET){
+                const std::chrono::microseconds p95 = rtt[fanout.server].p95;
+                hedged = p95.count() == 0;
+                hedge_delay = std::max(hedge_delay, p95);
+            }
+            iovecs[i].iov_base = fanout.request.data();
+            iovecs[i].iov_len = fanout.request.size();
+            msgs[i].msg_hdr = msghdr{};
+            msgs[i].msg_hdr.msg_name = &server_addrs[fanout.server];
+            msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            msgs[i].msg_hdr.msg_iov = &iovecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        const auto sent_at = std::chrono::steady_clock::now();
+        size_t sent = 0;
+        while(sent < pending.size()){
+            const int result = sendmmsg(socket_fd, msgs.data() + sent, static_cast<unsigned int>(pending.size() - sent), 0);
+            if(result <= 0){
+                break;
+            }
+            sent += static_cast<size_t>(result);
+        }
+
+        // Return as soon as every operation has its fastest quorum; slower replicas are not waited for
+        const auto deadline = sent_at + timeout;
+        const auto hedge_at = sent_at + hedge_delay;
+        while(reached < count){
+            if(!hedged && std::chrono::steady_clock::now() >= hedge_at){
+                hedged = true;
+                for(size_t i = 0; i < count && hedge_tokens >= 1; i++){
+                    if(operations[i].request != GET || acks[i] >= needed(i)){
+                        continue;
+                    }
+                    // Each short read gets one more replica, the next one in ring order
+                    for(size_t f = first[i]; f < first[i + 1]; f++){
+                        Fanout& fanout = fanouts[f];
+                        if(!fanout.sent){
+                            fanout.sent = true;
+                            fanout.hedge = true;
+                            const sockaddr_in& addr = server_addrs[fanout.server];
+                            sendto(socket_fd, fanout.request.data(), fanout.request.size(), 0,
+                                   reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+                            hedge_tokens -= 1;
+                            hedged_reads.fetch_add(1, std::memory_order_relaxed);
+                            break;
+                        }
+                    }
+                }
+            }
+            const auto wake = hedged ? deadline : std::min(deadline, hedge_at);
+            if(!wait_readable(wake)){
+                if(hedged || wake == deadline){
+                    break;
+                }
+                continue;
+            }
+
+            const ssize_t bytes_received = recv(socket_fd, receive_buffer.data(), receive_buffer.size(), MSG_DONTWAIT);
+            if(bytes_received == -1){
+                continue;
+            }
+
+            protocol::Message message;
+            const std::string_view datagram(receive_buffer.data(), static_cast<size_t>(bytes_received));
+            if(protocol::decode(datagram, message) == -1){
+                stale_count.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            if(message.header.request_id == 0){
+                continue;  // Ack of a read repair
+            }
+            const uint64_t id = message.header.request_id;
+            if(id < base_id || id - base_id >= fanouts.size() || fanouts[id - base_id].answered){
+                stale_count.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            Fanout& fanout = fanouts[id - base_id];
+            fanout.answered = true;
+            if(attempt == 0 && !fanout.hedge){
+                record_rtt(fanout.server, std::chrono::steady_clock::now() - sent_at);
+            }
+            if(fanout.hedge && acks[fanout.operation] < needed(fanout.operation)){
+                hedge_wins.fetch_add(1, std::memory_order_relaxed);
+            }
+            fanout.status = message.header.status;
+            fanout.value.assign(message.value);
+            if(protocol::unpack_version(message.extras, fanout.version) == -1){
+                fanout.version = 0;
+            }
+            if((fanout.status == protocol::OK || fanout.status == protocol::NOT_FOUND) &&
+               ++acks[fanout.operation] == needed(fanout.operation)){
+                reached++;
+            }
+        }
+
+        // Replicas that were still needed and stayed silent; each is backed off once per attempt
+        if(reached < count){
+            std::vector<uint32_t> silent;
+            for(const size_t f : pending){
+                if(!fanouts[f].answered && acks[fanouts[f].operation] < needed(fanouts[f].operation)){
+                    silent.push_back(fanouts[f].server);
+                }
+            }
+            std::ranges::sort(silent);
+            const auto [first_duplicate, last] = std::ranges::unique(silent);
+            silent.erase(first_duplicate, last);
+            for(const uint32_t server : silent){
+                back_off(server);
+            }
+        }
+    }
+
+    std::vector<std::string> repairs;
+    std::vector<uint32_t> repair_servers;
+    for(size_t i = 0; i < count; i++){
+        if(unavailable[i]){
+            results[i] = Result{};
+            results[i].code = ResultCode::UNAVAILABLE;
+            continue;
+        }
+        if(acks[i] < needed(i)){
+            results[i] = Result{};
+            continue;
+        }
+        if(operations[i].request == PUT){
+            results[i].code = ResultCode::OK;
+            continue;
+        }
+
+        const Fanout* newest = nullptr;
+        for(size_t f = first[i]; f < first[i + 1]; f++){
+            if(fanouts[f].answered && fanouts[f].status == protocol::OK &&
+               (newest == nullptr || fanouts[f].version > newest->version)){
+                newest = &fanouts[f];
+            }
+        }
+        results[i] = newest == nullptr ? make_result(protocol::NOT_FOUND, {}) : make_result(protocol::OK, newest->value);
+
+        // Unversioned values (plain PUTs) have nothing to order them by, so they are left alone
+        if(newest == nullptr || newest->version == 0){
+            continue;
+        }
+        for(size_t f = first[i]; f < first[i + 1]; f++){
+            const Fanout& fanout = fanouts[f];
+            if(fanout.answered && (fanout.status == protocol::NOT_FOUND ||
+                                   (fanout.status == protocol::OK && fanout.version < newest->version))){
+                protocol::Header header;
+                header.opcode = VPUT;
+                header.request_id = 0;
+                repairs.emplace_back();
+                protocol::encode(repairs.back(), header, protocol::pack_version(newest->version),
+                                 operations[i].key, newest->value);
+                repair_servers.push_back(fanout.server);
+            }
+        }
+    }
+
+    // Repairs are fire-and-forget: a lost one is simply redone by the next read that notices
+    if(!repairs.empty()){
+        std::vector<iovec> repair_iovecs(repairs.size());
+        std::vector<mmsghdr> repair_msgs(repairs.size());
+        for(size_t r = 0; r < repairs.size(); r++){
+            repair_iovecs[r] = iovec{repairs[r].data(), repairs[r].size()};
+            repair_msgs[r].msg_hdr = msghdr{};
+            repair_msgs[r].msg_hdr.msg_name = &server_addrs[repair_servers[r]];
+            repair_msgs[r].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            repair_msgs[r].msg_hdr.msg_iov = &repair_iovecs[r];
+            repair_msgs[r].msg_hdr.msg_iovlen = 1;
+        }
+        sendmmsg(socket_fd, repair_msgs.data(), static_cast<unsigned int>(repair_msgs.size()), 0);
+        read_repairs.fetch_add(repairs.size(), std::memory_order_relaxed);
+    }
+
+    successful_ops.fetch_add(reached - unavailable_ops, std::memory_order_relaxed);
+    unavailable_count.fetch_add(unavailable_ops, std::memory_order_relaxed);
+    if(running.load(std::memory_order_relaxed)){
+        timeout_count.fetch_add(count - reached, std::memory_order_relaxed);
+    }
+}
+
+Result Client::execute_text(const Operation& operation)
+{
+    const std::string request_str = serialize_request(operation, 0);
+    const sockaddr_in& addr = target(operation.request, operation.server);
+
+    for(int attempt = 0; attempt < MAX_ATTEMPTS && running.load(std::memory_order_relaxed); attempt++){
+        if(attempt > 0){
+            pause_before_retry(attempt);
+        }
+        const auto sent_at = std::chrono::steady_clock::now();
+        if(sendto(socket_fd, request_str.data(), request_str.size(), 0, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == -1){
+            continue;
+        }
+
+        // Text replies carry no id, so whatever arrives first is taken as the answer
+        const auto deadline = sent_at + timeout_for(operation.server);
+        while(wait_readable(deadline)){
+            const ssize_t bytes_received = recv(socket_fd, receive_buffer.data(), receive_buffer.size(), MSG_DONTWAIT);
+            if(bytes_received >= 0){
+                if(attempt == 0){
+                    record_rtt(operation.server, std::chrono::steady_clock::now() - sent_at);
+                }
+                Result result = parse_text_response(operation, std::string_view(receive_buffer.data(), static_cast<size_t>(bytes_received)));
+                count_result(result);
+                return result;
+            }
+        }
+        back_off(operation.server);
+    }
+
+    if(running.load(std::memory_order_relaxed)){
         timeout_count.fetch_add(1, std::memory_order_relaxed);
     }
-    return std::nullopt;
+    return Result{};
 }
 
-std::string Client::serialize_request(const Request& request, const std::string& key, const std::optional<std::string>& value)
+std::vector<Result> Client::execute(const std::vector<Operation>& operations)
 {
-    std::string request_str = request == PUT ? "PUT" : "GET";
-    request_str += ":" + key;
-    if(request == PUT && value.has_value()){
-        request_str += ":" + value.value();
+    if(near_cache_capacity == 0 && !spreading.load(std::memory_order_relaxed)){
+        return execute_remote(operations);
+    }
+
+    // Reads of keys under a live lease are answered here, and reads of keys their owner copied to
+    // every server go to a random one; the rest take the usual route
+    const auto now = std::chrono::steady_clock::now();
+    std::vector<Result> results(operations.size());
+    std::vector<size_t> misses;
+    std::vector<Operation> remote;
+    {
+        std::lock_guard lock(cache_mutex);
+        for(size_t i = 0; i < operations.size(); i++){
+            if(operations[i].request == GET && read_cache(operations[i].key, now, results[i])){
+                continue;
+            }
+            misses.push_back(i);
+            remote.push_back(operations[i]);
+            if(operations[i].request == GET && spread_target(operations[i].key, now, remote.back().server) &&
+               remote.back().server != operations[i].server){
+                spread_reads.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+    const size_t hits = operations.size() - misses.size();
+    if(hits > 0){
+        cache_hits.fetch_add(hits, std::memory_order_relaxed);
+        successful_ops.fetch_add(hits, std::memory_order_relaxed);
+    }
+    if(misses.empty()){
+        return results;
+    }
+
+    std::vector<Result> fetched = execute_remote(remote);
+    std::vector<size_t> fallback;  // Reads sent to a server whose copy was gone; indices into misses
+    {
+        std::lock_guard lock(cache_mutex);
+        for(size_t j = 0; j < misses.size(); j++){
+            const Operation& operation = operations[misses[j]];
+            if(operation.request != GET){
+                results[misses[j]] = std::move(fetched[j]);
+                continue;
+            }
+            if(fetched[j].spread){
+                spread_keys.insert_or_assign(operation.key, now + SPREAD_INTERVAL);
+            } else if(remote[j].server != operation.server){
+                spread_keys.erase(operation.key);
+                if(fetched[j].code == ResultCode::NOT_FOUND){
+                    fallback.push_back(j);
+                    continue;
+                }
+            }
+            if(near_cache_capacity > 0 && fetched[j].ok() &&
+               fetched[j].lease_expiry != std::chrono::steady_clock::time_point{}){
+                fill_cache(operation.key, fetched[j]);
+            }
+            results[misses[j]] = std::move(fetched[j]);
+        }
+    }
+
+    if(!fallback.empty()){
+        std::vector<Operation> owners;
+        owners.reserve(fallback.size());
+        for(const size_t j : fallback){
+            owners.push_back(operations[misses[j]]);
+        }
+        std::vector<Result> retried = execute_remote(owners);
+        for(size_t k = 0; k < fallback.size(); k++){
+            results[misses[fallback[k]]] = std::move(retried[k]);
+        }
+    }
+    return results;
+}
+
+bool Client::spread_target(const std::string& key, const std::chrono::steady_clock::time_point now, size_t& server)
+{
+    // Called with cache_mutex held. Any live server will do, the owner included
+    const auto found = spread_keys.find(key);
+    if(found == spread_keys.end()){
+        return false;
+    }
+    if(now >= found->second){
+        spread_keys.erase(found);
+        return false;
+    }
+
+    std::shared_lock lock(ring_mutex);
+    const size_t pick = spread_pick() % num_servers;
+    if(in_ring[pick]){
+        server = pick;
+    }
+    return true;
+}
+
+bool Client::read_cache(const std::string& key, const std::chrono::steady_clock::time_point now, Result& result)
+{
+    // Called with cache_mutex held
+    const auto found = near_cache.find(key);
+    if(found == near_cache.end()){
+        return false;
+    }
+    if(now >= found->second.expiry){
+        near_cache.erase(found);
+        return false;
+    }
+    result.code = ResultCode::OK;
+    result.value = found->second.value;
+    result.hot = true;
+    result.lease_expiry = found->second.expiry;
+    return true;
+}
+
+void Client::fill_cache(const std::string& key, const Result& result)
+{
+    // Called with cache_mutex held. When full, expired leases make room first, then an arbitrary entry
+    if(near_cache.size() >= near_cache_capacity && !near_cache.contains(key)){
+        const auto now = std::chrono::steady_clock::now();
+        std::erase_if(near_cache, [now](const auto& entry) { return now >= entry.second.expiry; });
+        if(near_cache.size() >= near_cache_capacity){
+            near_cache.erase(near_cache.begin());
+        }
+    }
+    near_cache.insert_or_assign(key, CachedValue{result.value, result.lease_expiry});
+}
+
+std::vector<Result> Client::execute_remote(const std::vector<Operation>& operations)
+{
+    std::vector<Result> results(operations.size());
+
+    // The lock is taken per round trip so one large multi-op cannot starve other callers
+    for(size_t offset = 0; offset < operations.size(); offset += MAX_BATCH){
+        const size_t count = std::min(MAX_BATCH, operations.size() - offset);
+        std::lock_guard lock(io_mutex);
+        const auto now = std::chrono::steady_clock::now();
+        if(membership_refresh.count() > 0 && now >= next_refresh){
+            next_refresh = now + membership_refresh;
+            refresh_membership();
+        }
+        if(quorum){
+            execute_quorum(operations.data() + offset, count, results.data() + offset);
+            continue;
+        }
+        if(format == WireFormat::BINARY){
+            execute_binary(operations.data() + offset, count, results.data() + offset);
+            continue;
+        }
+        for(size_t i = offset; i < offset + count; i++){
+            results[i] = execute_text(operations[i]);
+        }
+    }
+    return results;
+}
+
+Result Client::get(const std::string& key)
+{
+    return std::move(execute({make_operation(GET, key, {})}).front());
+}
+
+Result Client::put(const std::string& key, const std::string& value)
+{
+    return std::move(execute({make_operation(PUT, key, value)}).front());
+}
+
+std::vector<Result> Client::execute_packed(const Request opcode, const std::vector<Operation>& entries)
+{
+    std::vector<Result> results(entries.size());
+    std::vector<Operation> packets;
+    std::vector<std::vector<size_t>> members;  // Indices into entries carried by each packet
+
+    // One open packet per server, replaced once the next entry would not fit in a request datagram.
+    // Sized as servers show up, since a redirect may have grown the ring since the entries were routed
+    std::vector<size_t> open;
+    for(size_t i = 0; i < entries.size(); i++){
+        const Operation& entry = entries[i];
+        if(entry.server >= open.size()){
+            open.resize(entry.server + 1, SIZE_MAX);
+        }
+        const size_t size = opcode == MGET ? protocol::packed_key_size(entry.key)
+                                           : protocol::packed_pair_size(entry.key, entry.value);
+        size_t& packet = open[entry.server];
+        if(packet == SIZE_MAX || protocol::HEADER_SIZE + packets[packet].value.size() + size > protocol::MAX_REQUEST_SIZE){
+            packets.push_back(Operation{opcode, {}, {}, entry.server});
+            members.emplace_back();
+            packet = packets.size() - 1;
+        }
+
+        if(opcode == MGET){
+            protocol::pack_key(packets[packet].value, entry.key);
+        } else {
+            protocol::pack_pair(packets[packet].value, entry.key, entry.value);
+        }
+        members[packet].push_back(i);
+    }
+
+    const std::vector<Result> packet_results = execute(packets);
+
+    std::vector<std::pair<protocol::Status, std::string_view>> unpacked;
+    std::vector<size_t> refetch;
+    for(size_t p = 0; p < packets.size(); p++){
+        const Result& packet_result = packet_results[p];
+        if(packet_result.code == ResultCode::TIMEOUT && !routable(packets[p].server)){
+            // The server died under this packet; its entries now belong to other servers
+            refetch.insert(refetch.end(), members[p].begin(), members[p].end());
+            continue;
+        }
+        if(!packet_result.ok() || protocol::unpack_results(opcode, packet_result.value, unpacked) == -1 ||
+           unpacked.size() != members[p].size()){
+            for(const size_t i : members[p]){
+                results[i].code = packet_result.ok() ? ResultCode::REJECTED : packet_result.code;
+            }
+            continue;
+        }
+
+        for(size_t j = 0; j < unpacked.size(); j++){
+            if(unpacked[j].first == protocol::TRUNCATED || unpacked[j].first == protocol::MOVED){
+                refetch.push_back(members[p][j]);
+                continue;
+            }
+            results[members[p][j]] = make_result(unpacked[j].first, unpacked[j].second);
+        }
+    }
+
+    // Values squeezed out of a full reply, keys that moved, and keys of a dead server are sent one
+    // by one; single-key replies name the new owner and single keys are rerouted around the dead
+    if(!refetch.empty()){
+        std::vector<Operation> singles;
+        singles.reserve(refetch.size());
+        for(const size_t i : refetch){
+            singles.push_back(entries[i]);
+        }
+        std::vector<Result> single_results = execute(singles);
+        for(size_t j = 0; j < refetch.size(); j++){
+            results[refetch[j]] = std::move(single_results[j]);
+        }
+    }
+    return results;
+}
+
+std::vector<Result> Client::multi_get(const std::vector<std::string>& keys)
+{
+    std::vector<Operation> operations;
+    operations.reserve(keys.size());
+    for(const std::string& key : keys){
+        operations.push_back(make_operation(GET, key, {}));
+    }
+    // Quorum keys each live on several servers, so they are not packed per server
+    return format == WireFormat::BINARY && !quorum ? execute_packed(MGET, operations) : execute(operations);
+}
+
+std::vector<Result> Client::multi_put(const std::vector<std::pair<std::string, std::string>>& entries)
+{
+    std::vector<Operation> operations;
+    operations.reserve(entries.size());
+    for(const auto& [key, value] : entries){
+        operations.push_back(make_operation(PUT, key, value));
+    }
+    return format == WireFormat::BINARY && !quorum ? execute_packed(MPUT, operations) : execute(operations);
+}
+
+void Client::submit(Operation operation, Callback callback)
+{
+    if(!running.load(std::memory_order_relaxed)){
+        callback(Result{});
+        return;
+    }
+
+    std::call_once(dispatcher_started, [this] { dispatcher = std::thread(&Client::dispatch, this); });
+    async_queue.enqueue(AsyncOperation{std::move(operation), std::move(callback)});
+    async_waiter.notify();
+}
+
+void Client::get_async(const std::string& key, Callback callback)
+{
+    submit(make_operation(GET, key, {}), std::move(callback));
+}
+
+void Client::put_async(const std::string& key, const std::string& value, Callback callback)
+{
+    submit(make_operation(PUT, key, value), std::move(callback));
+}
+
+std::future<Result> Client::get_async(const std::string& key)
+{
+    auto promise = std::make_shared<std::promise<Result>>();
+    std::future<Result> future = promise->get_future();
+    get_async(key, [promise](Result result) { promise->set_value(std::move(result)); });
+    return future;
+}
+
+std::future<Result> Client::put_async(const std::string& key, const std::string& value)
+{
+    auto promise = std::make_shared<std::promise<Result>>();
+    std::future<Result> future = promise->get_future();
+    put_async(key, value, [promise](Result result) { promise->set_value(std::move(result)); });
+    return future;
+}
+
+void Client::dispatch()
+{
+    // Everything queued since the last round trip goes out together
+    AsyncOperation batch[MAX_BATCH];
+    std::vector<Operation> operations;
+    unsigned idle_rounds = 0;
+
+    while(running.load(std::memory_order_relaxed)){
+        const size_t count = async_queue.try_dequeue_bulk(batch, MAX_BATCH);
+        if(count == 0){
+            async_waiter.wait(idle_rounds, [this] { return async_queue.size_approx() > 0; });
+            continue;
+        }
+        idle_rounds = 0;
+
+        operations.clear();
+        for(size_t i = 0; i < count; i++){
+            operations.push_back(std::move(batch[i].operation));
+        }
+
+        std::vector<Result> results = execute(operations);
+        for(size_t i = 0; i < count; i++){
+            batch[i].callback(std::move(results[i]));
+            batch[i].callback = nullptr;
+        }
+    }
+}
+
+void Client::stop()
+{
+    running.store(false);
+    async_waiter.notify_all();
+}
+
+void Client::set_key_skew(const double exponent)
+{
+    key_cdf.clear();
+    if(exponent <= 0){
+        return;
+    }
+
+    // Key k (0-based) has weight 1 / (k + 1)^exponent
+    constexpr size_t KEYS = 10001;
+    key_cdf.resize(KEYS);
+    double total = 0;
+    for(size_t k = 0; k < KEYS; k++){
+        total += 1.0 / std::pow(static_cast<double>(k + 1), exponent);
+        key_cdf[k] = total;
+    }
+    for(double& cumulative : key_cdf){
+        cumulative /= total;
     }
-    return request_str;
 }
 
 void Client::run()
@@ -98,17 +1238,25 @@ void Client::run()
     std::mt19937 gen(rd());
     std::uniform_int_distribution op_dist(0, 1);
     std::uniform_int_distribution key_value_dist(0, 10000);
+    std::uniform_real_distribution<double> skew_dist(0, 1);
+    const auto next_key = [&] {
+        if(key_cdf.empty()){
+            return key_value_dist(gen);
+        }
+        const auto found = std::ranges::upper_bound(key_cdf, skew_dist(gen));
+        return static_cast<int>(std::min<ptrdiff_t>(found - key_cdf.begin(), std::ssize(key_cdf) - 1));
+    };
 
     while(running.load(std::memory_order_relaxed)){
         if(const int operation = op_dist(gen); operation == 0){
             // PUT operation: generate random key and value
-            const int key = key_value_dist(gen);
+            const int key = next_key();
             const int value = key_value_dist(gen);
-            send_request(PUT, std::to_string(key), std::to_string(value));
+            put(std::to_string(key), std::to_string(value));
         } else {
             // GET operation: generate random key
-            const int key = key_value_dist(gen);
-            send_request(GET, std::to_string(key), std::nullopt);
+            const int key = next_key();
+            get(std::to_string(key));
         }
     }
 }
@@ -1,37 +1,270 @@
 #ifndef DISTIBUTED_HASH_TABLE_CLIENT_H
 #define DISTIBUTED_HASH_TABLE_CLIENT_H
-#include <any>
 #include <array>
 #include <atomic>
-#include <optional>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <netinet/in.h>
 
+#include "./HashRing.h"
+#include "./IdleWaiter.h"
+#include "./Protocol.h"
 #include "./Request.h"
+#include "./ds/concurrentqueue.h"
 
+enum class ResultCode
+{
+    OK,
+    NOT_FOUND,   // GET of a missing key
+    NOT_STORED,  // PUT of a key that already exists
+    REJECTED,    // Server could not parse the request
+    TIMEOUT,     // No reply after every retry, or the client was stopped
+    UNAVAILABLE, // Fewer live replicas than the read or write quorum
+};
+
+struct Result
+{
+    ResultCode code = ResultCode::TIMEOUT;
+    std::string value;  // Only set for a successful GET
+    bool hot = false;   // The server flagged the key as hot; a candidate for caching
+    bool spread = false;  // The key is copied to every server, so any of them may answer reads of it
+    // Set when the server granted a lease: until then the value may be served from a cache
+    std::chrono::steady_clock::time_point lease_expiry{};
+
+    bool ok() const { return code == ResultCode::OK; }
+};
 
+// Embeddable DHT client. The synchronous calls may be used from several threads; they take
+// turns on the socket. Async calls are batched by a background dispatcher thread, started on
+// first use, and their callbacks run on that thread.
 class Client
 {
+public:
+    using Callback = std::function<void(Result)>;
+
+private:
+    // Per-server timeouts follow the measured round trip (RFC 6298: SRTT + 4 * RTTVAR), starting
+    // from INITIAL_TIMEOUT until a server has answered, and double after each timeout until it answers again
+    static constexpr std::chrono::microseconds INITIAL_TIMEOUT{15000};
+    static constexpr std::chrono::microseconds MIN_TIMEOUT{2000};
+    static constexpr std::chrono::microseconds MAX_TIMEOUT{200000};
+    static constexpr unsigned MAX_BACKOFF = 6;  // Doublings
+    // Pause before a retry: uniformly random up to RETRY_PAUSE << attempt, so clients that lost
+    // replies together do not retry together
+    static constexpr std::chrono::microseconds RETRY_PAUSE{250};
+    static constexpr int MAX_ATTEMPTS = 3;
+    static constexpr size_t RTT_WINDOW = 64;         // Recent samples kept per server for its p95
+    static constexpr size_t MIN_HEDGE_SAMPLES = 32;  // Servers with fewer have no p95 and are not hedged
+    static constexpr double MAX_HEDGE_BURST = 10;    // Hedges a quiet client may save up
+    static constexpr size_t MAX_BATCH = 64;  // Requests pipelined per round trip
+    static constexpr int MAX_REDIRECTS = 2;  // MOVED replies followed per request
+    static constexpr int VERSION_TAG_BITS = 12;  // Versions are microseconds << 12 | client tag
+    static constexpr uint64_t VERSION_TAG_MASK = (uint64_t{1} << VERSION_TAG_BITS) - 1;
+    static constexpr std::chrono::milliseconds FORCED_REFRESH_INTERVAL{50};  // Floor between refreshes forced by timeouts
+    static constexpr std::chrono::milliseconds SPREAD_INTERVAL{1000};  // How long one SPREAD reply lets reads go anywhere
+
+    struct Operation
+    {
+        Request request{};
+        std::string key;
+        std::string value;  // Packed entries for MGET/MPUT
+        size_t server = 0;
+    };
+
+    // Jacobson/Karels round-trip estimate for one server
+    struct RttEstimate
+    {
+        std::chrono::microseconds srtt{0};
+        std::chrono::microseconds rttvar{0};
+        bool sampled = false;
+        unsigned backoff = 0;
+        std::array<uint32_t, RTT_WINDOW> recent{};  // Microseconds, written round-robin
+        size_t samples = 0;
+        std::chrono::microseconds p95{0};  // Refreshed every 16 samples; zero until MIN_HEDGE_SAMPLES
+    };
+
+    struct CachedValue
+    {
+        std::string value;
+        std::chrono::steady_clock::time_point expiry;
+    };
+
+    struct AsyncOperation
+    {
+        Operation operation;
+        Callback callback;
+    };
+
     int socket_fd;
-    std::array<sockaddr_in, 3> server_addrs;
-    size_t num_servers;  // Actual number of servers (not array size)
+    std::vector<sockaddr_in> server_addrs;
+    std::vector<sockaddr_in> read_addrs;  // Chain tails, parallel to server_addrs; empty when reads go to the heads
+    size_t num_servers;
+    HashRing ring;       // Node ids are indices into server_addrs
+    std::vector<bool> in_ring;  // Parallel to server_addrs; false while the servers report it dead
+    std::vector<RttEstimate> rtt;  // Parallel to server_addrs; guarded by io_mutex
+    std::minstd_rand retry_jitter;  // Guarded by io_mutex
+    mutable std::shared_mutex ring_mutex;  // Lets route() run outside io_mutex while learn() grows the ring
+    WireFormat format;
+    uint64_t next_request_id = 1;
+    bool quorum = false;  // Set by set_quorum
+    size_t replication_factor = 1;
+    size_t read_quorum = 1;
+    size_t write_quorum = 1;
+    double hedge_budget = 0;  // Hedges per quorum read; 0 disables hedging
+    double hedge_tokens = 0;  // Guarded by io_mutex
+    uint64_t client_tag;     // Low bits of every version this client mints
+    uint64_t last_tick = 0;  // Clock reading behind the newest version
+    std::chrono::milliseconds membership_refresh{0};  // 0 until set_membership_refresh
+    uint64_t membership_version = 0;
+    size_t refresh_cursor = 0;  // Next server asked for the membership
+    std::chrono::steady_clock::time_point next_refresh;
+    std::chrono::steady_clock::time_point next_forced_refresh;
+    std::mutex io_mutex;  // Guards the socket, receive_buffer, next_request_id, last_tick and the refresh state
+    std::vector<char> receive_buffer;
     std::atomic<bool> running{true};
-    std::atomic<uint64_t> successful_ops{0};
+    std::atomic<uint64_t> successful_ops{0};    // OK and NOT_FOUND replies, quorum reads and writes, cache hits
+    std::atomic<uint64_t> not_stored_count{0};  // PUTs of keys that already exist
+    std::atomic<uint64_t> error_count{0};       // Rejected requests, including MOVED past MAX_REDIRECTS
     std::atomic<uint64_t> timeout_count{0};
+    std::atomic<uint64_t> unavailable_count{0};  // Quorum operations with too few live owners
+    std::atomic<uint64_t> stale_count{0};
+    std::atomic<uint64_t> read_repairs{0};
+    std::atomic<uint64_t> membership_changes{0};
+    std::atomic<uint64_t> hedged_reads{0};
+    std::atomic<uint64_t> hedge_wins{0};
+    std::atomic<uint64_t> hot_hints{0};  // Replies flagged HOT_KEY
+    std::vector<double> key_cdf;  // Zipf CDF over the benchmark keys; empty for uniform keys
+    size_t near_cache_capacity = 0;  // 0 until set_near_cache
+    std::mutex cache_mutex;  // Guards near_cache, spread_keys and spread_pick; never held across a round trip
+    std::unordered_map<std::string, CachedValue> near_cache;
+    std::atomic<uint64_t> cache_hits{0};
+    // Keys their owner copied to every server, until when reads may go to a random one
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point> spread_keys;
+    std::minstd_rand spread_pick;
+    std::atomic<bool> spreading{false};  // Set by the first SPREAD reply
+    std::atomic<uint64_t> spread_reads{0};
+
+    moodycamel::ConcurrentQueue<AsyncOperation> async_queue;
+    IdleWaiter async_waiter{WaitPolicy::BLOCKING};
+    std::once_flag dispatcher_started;
+    std::thread dispatcher;
 
-    int try_send_request(const Request &request, const std::string &key, const std::optional<std::string> &value) const;
-    std::any receive_response();
-    static std::string serialize_request(const Request &request, const std::string &key, const std::optional<std::string> &value);
-    std::any send_request(const Request &request, const std::string &key, const std::optional<std::string> &value);
+    size_t route(const std::string &key) const;
+    const sockaddr_in& target(Request request, size_t server) const;
+    size_t reroute(const Operation &operation, size_t server) const;
+    bool routable(size_t server) const;
+    Operation make_operation(Request request, const std::string &key, const std::string &value) const;
+    std::string serialize_request(const Operation &operation, uint64_t request_id) const;
+    static Result make_result(protocol::Status status, std::string_view value);
+    // Tallies a reply the same way AsyncClient does: only OK and NOT_FOUND are successes
+    void count_result(const Result &result);
+    static Result parse_text_response(const Operation &operation, std::string_view datagram);
+    bool wait_readable(std::chrono::steady_clock::time_point deadline) const;
+    std::chrono::microseconds timeout_for(size_t server) const;
+    void record_rtt(size_t server, std::chrono::steady_clock::duration sample);
+    void back_off(size_t server);
+    void pause_before_retry(int attempt);
+    std::vector<Result> execute(const std::vector<Operation> &operations);
+    std::vector<Result> execute_remote(const std::vector<Operation> &operations);
+    bool read_cache(const std::string &key, std::chrono::steady_clock::time_point now, Result &result);
+    void fill_cache(const std::string &key, const Result &result);
+    bool spread_target(const std::string &key, std::chrono::steady_clock::time_point now, size_t &server);
+    void execute_binary(const Operation *operations, size_t count, Result *results, int redirects = 0);
+    void learn(std::string_view endpoint);
+    size_t find_server(const sockaddr_in &addr) const;
+    void add_server(const sockaddr_in &addr);
+    bool refresh_membership();
+    void apply_membership(const std::vector<std::string_view> &names);
+    Result execute_text(const Operation &operation);
+    void execute_quorum(const Operation *operations, size_t count, Result *results);
+    uint64_t next_version();
+    std::vector<Result> execute_packed(Request opcode, const std::vector<Operation> &entries);
+    void submit(Operation operation, Callback callback);
+    void dispatch();
 
 public:
-    Client(const std::array<sockaddr_in, 3> &server_addrs, size_t num_servers, uint16_t client_port = 0);
+    explicit Client(std::vector<sockaddr_in> server_addrs, uint16_t client_port = 0,
+           WireFormat format = WireFormat::BINARY, size_t virtual_nodes = HashRing::DEFAULT_VNODES);
     ~Client();
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    // Dynamo-style quorums: every key lives on the first `replicas` ring owners, a PUT returns once
+    // `writes` of them have it and a GET once `reads` have answered, with the newest version winning.
+    // Quorum PUTs overwrite (last writer wins, ordered by a wall-clock version) instead of failing on
+    // an existing key. Replicas seen returning an older version are repaired in the background.
+    // Binary protocol only; must be called before the first request. Returns false if the sizes are invalid.
+    bool set_quorum(size_t replicas, size_t reads, size_t writes);
+
+    // Quorum reads first ask only `reads` replicas. If one has not answered within its server's
+    // recent p95 round trip, one more replica is asked and whichever replies first counts. Hedges are
+    // capped at `budget` (e.g. 0.05) per read. Replicas a read did not ask are not read-repaired by it.
+    // Requires set_quorum first; must be called before the first request. Returns false if invalid.
+    bool set_hedging(double budget);
+
+    // Follows the servers' gossip membership: at most once per interval, and sooner after a timeout,
+    // a request first asks a server for the live members (MEMBERS) and, if their version changed,
+    // drops dead servers from the ring and adds new ones. Keys of a dead server are routed to the
+    // next ring owner, which only has them if quorums keep replicas there. Binary protocol, and not
+    // with chain reads; must be called before the first request. Returns false if unsupported.
+    bool set_membership_refresh(std::chrono::milliseconds interval);
+
+    // Near cache: GETs ask for a lease, and values the server leases (hot keys not written within
+    // the lease term) are kept for up to `capacity` keys and answered locally until the lease ends,
+    // counted from when the request was sent. A write from another client may so go unseen for one
+    // term. MGET is not cached. Binary protocol, and not with quorums or chain reads; must be called
+    // before the first request. Returns false if unsupported.
+    bool set_near_cache(size_t capacity);
+
+    // For chain replication: GET/MGET go to the tail of each chain while writes keep going to the
+    // head given to the constructor. Must be called before the first request.
+    void set_read_servers(std::vector<sockaddr_in> tails);
+
+    // Binary clients without quorums or chain reads send reads of a key flagged SPREAD to a random
+    // live server for a while after each such reply, and back to its owner if a copy has gone
+    Result get(const std::string &key);
+    Result put(const std::string &key, const std::string &value);
+
+    std::future<Result> get_async(const std::string &key);
+    std::future<Result> put_async(const std::string &key, const std::string &value);
+    void get_async(const std::string &key, Callback callback);
+    void put_async(const std::string &key, const std::string &value, Callback callback);
+
+    // Results are returned in the order of the inputs. Keys are packed into MGET/MPUT datagrams,
+    // one or more per server; the text protocol falls back to pipelined single requests
+    std::vector<Result> multi_get(const std::vector<std::string> &keys);
+    std::vector<Result> multi_put(const std::vector<std::pair<std::string, std::string>> &entries);
+
+    // Benchmark load generator: random GET/PUT until stop()
     void run();
-    void stop() { running.store(false); }
+    // Makes run() draw keys from a Zipf distribution with this exponent, so a few keys take most of
+    // the traffic; 0 keeps them uniform. Must be called before run().
+    void set_key_skew(double exponent);
+    // Fails any outstanding work with TIMEOUT; the client cannot be restarted
+    void stop();
     uint64_t get_successful_ops() const { return successful_ops.load(); }
+    uint64_t get_not_stored_count() const { return not_stored_count.load(); }
+    uint64_t get_error_count() const { return error_count.load(); }
     uint64_t get_timeout_count() const { return timeout_count.load(); }
+    uint64_t get_unavailable_count() const { return unavailable_count.load(); }
+    uint64_t get_stale_count() const { return stale_count.load(); }
+    uint64_t get_read_repairs() const { return read_repairs.load(); }
+    uint64_t get_membership_changes() const { return membership_changes.load(); }
+    uint64_t get_hedged_reads() const { return hedged_reads.load(); }
+    uint64_t get_hedge_wins() const { return hedge_wins.load(); }
+    uint64_t get_hot_hints() const { return hot_hints.load(); }
+    uint64_t get_cache_hits() const { return cache_hits.load(); }
+    uint64_t get_spread_reads() const { return spread_reads.load(); }
 };
 
 
-#endif //DISTIBUTED_HASH_TABLE_CLIENT_H
\ No newline at end of file
+#endif //DISTIBUTED_HASH_TABLE_CLIENT_H
@@ -0,0 +1,447 @@
+#include "Gossip.h"
+
+#include <algorithm>
+#include <bit>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "HashRing.h"
+#include "NetIo.h"
+
+namespace
+{
+// Each record is a (name, state + incarnation) pair, packed like MPUT entries
+std::string make_record(const MemberState state, const uint64_t incarnation)
+{
+    std::string record(1, static_cast<char>(state));
+    record += protocol::pack_version(incarnation);
+    return record;
+}
+
+// Later incarnations win; within one incarnation ALIVE < SUSPECT < DEAD
+bool supersedes(const MemberState state, const uint64_t incarnation, const MemberState old_state,
+                const uint64_t old_incarnation)
+{
+    return incarnation > old_incarnation ||
+           (incarnation == old_incarnation && static_cast<uint8_t>(state) > static_cast<uint8_t>(old_state));
+}
+}
+
+Gossip::Gossip(std::string self_name, std::vector<sockaddr_in> seeds) : seeds(std::move(seeds))
+{
+    // A restarted server must outrank the DEAD record left behind by its previous run
+    Member self;
+    self.name = std::move(self_name);
+    parse_endpoint(self.name, 0, self.addr);
+    self.incarnation = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    members.push_back(std::move(self));
+    enqueue_update(0);
+}
+
+Gossip::~Gossip()
+{
+    stop();
+    join();
+    if (socket_fd != -1)
+    {
+        close(socket_fd);
+    }
+}
+
+int Gossip::start()
+{
+    socket_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (socket_fd == -1)
+    {
+        return -1;
+    }
+
+    running.store(true, std::memory_order_relaxed);
+    worker = std::thread(&Gossip::run, this);
+    return 0;
+}
+
+void Gossip::stop()
+{
+    running.store(false, std::memory_order_relaxed);
+}
+
+void Gossip::join()
+{
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+}
+
+size_t Gossip::find(const std::string_view name) const
+{
+    for (size_t i = 0; i < members.size(); ++i)
+    {
+        if (members[i].name == name)
+        {
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+void Gossip::enqueue_update(const size_t member)
+{
+    // A member has at most one pending update; a newer state restarts its retransmissions
+    std::erase_if(updates, [member](const Update& update) { return update.member == member; });
+    updates.push_back(Update{member});
+}
+
+void Gossip::apply(const std::string_view name, const MemberState state, const uint64_t incarnation)
+{
+    const size_t index = find(name);
+    if (index == 0)
+    {
+        // Refute suspicion (or a premature death) by outbidding it
+        if (state != MemberState::ALIVE && incarnation >= members[0].incarnation)
+        {
+            members[0].incarnation = incarnation + 1;
+            enqueue_update(0);
+        }
+        return;
+    }
+
+    const auto now = Clock::now();
+    if (index == SIZE_MAX)
+    {
+        Member member;
+        if (state == MemberState::DEAD || parse_endpoint(name, 0, member.addr) == -1)
+        {
+            return;
+        }
+        member.name = std::string(name);
+        member.state = state;
+        member.incarnation = incarnation;
+        member.suspected_at = now;
+        members.push_back(std::move(member));
+
+        // New members join the probe rotation at a random position
+        std::uniform_int_distribution<size_t> position(0, probe_order.size());
+        probe_order.insert(probe_order.begin() + static_cast<std::ptrdiff_t>(position(rng)), members.size() - 1);
+        enqueue_update(members.size() - 1);
+        return;
+    }
+
+    Member& member = members[index];
+    if (!supersedes(state, incarnation, member.state, member.incarnation))
+    {
+        return;
+    }
+    if (state == MemberState::SUSPECT && member.state != MemberState::SUSPECT)
+    {
+        member.suspected_at = now;
+        suspected_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (state == MemberState::DEAD && member.state != MemberState::DEAD)
+    {
+        dead_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    member.state = state;
+    member.incarnation = incarnation;
+    enqueue_update(index);
+}
+
+std::string Gossip::encode(const MessageType type, const uint64_t sequence, const std::string_view key,
+                           const bool full_state, const size_t limit)
+{
+    const size_t budget = limit - protocol::HEADER_SIZE - key.size();
+
+    // The sender's own record always leads, so receivers learn of new members from their first message
+    std::string packed;
+    protocol::pack_pair(packed, members[0].name, make_record(members[0].state, members[0].incarnation));
+
+    const auto append = [&](const Member& member) {
+        const std::string record = make_record(member.state, member.incarnation);
+        if (packed.size() + protocol::packed_pair_size(member.name, record) > budget)
+        {
+            return false;
+        }
+        protocol::pack_pair(packed, member.name, record);
+        return true;
+    };
+
+    if (full_state)
+    {
+        for (size_t i = 1; i < members.size() && append(members[i]); ++i)
+        {
+        }
+    }
+    else
+    {
+        const unsigned max_transmissions = RETRANSMIT_MULT * std::max(1u, static_cast<unsigned>(std::bit_width(members.size())));
+        for (size_t sent = 0; sent < MAX_PIGGYBACK && sent < updates.size(); ++sent)
+        {
+            Update update = updates.front();
+            updates.pop_front();
+            if (update.member != 0 && !append(members[update.member]))
+            {
+                updates.push_front(update);
+                break;
+            }
+            if (++update.transmissions < max_transmissions)
+            {
+                updates.push_back(update);
+            }
+        }
+    }
+
+    protocol::Header header;
+    header.opcode = GOSSIP;
+    header.flags = type;
+    header.request_id = sequence;
+    std::string datagram;
+    protocol::encode(datagram, header, {}, key, packed);
+    return datagram;
+}
+
+void Gossip::absorb(const std::string_view packed)
+{
+    std::vector<std::pair<std::string_view, std::string_view>> records;
+    if (protocol::unpack_pairs(packed, records) == -1)
+    {
+        return;
+    }
+
+    for (const auto& [name, record] : records)
+    {
+        uint64_t incarnation = 0;
+        if (record.empty() || static_cast<uint8_t>(record.front()) > static_cast<uint8_t>(MemberState::DEAD) ||
+            protocol::unpack_version(record.substr(1), incarnation) == -1)
+        {
+            continue;
+        }
+        apply(name, static_cast<MemberState>(record.front()), incarnation);
+    }
+}
+
+std::string Gossip::handle(const uint8_t type, const uint64_t sequence, const std::string_view key,
+                           const std::string_view packed, const sockaddr_in& source)
+{
+    std::lock_guard lock(mutex);
+
+    // A sender we have never heard of is joining, so it gets everything we know rather than the recent news
+    std::vector<std::pair<std::string_view, std::string_view>> records;
+    const bool joining = protocol::unpack_pairs(packed, records) == 0 && !records.empty() &&
+                         find(records.front().first) == SIZE_MAX;
+    absorb(packed);
+
+    if (type == PING)
+    {
+        return encode(ACK, sequence, {}, joining, protocol::MAX_RESPONSE_SIZE);
+    }
+
+    if (type == PING_REQ)
+    {
+        const size_t target = find(key);
+        if (target == SIZE_MAX || target == 0)
+        {
+            return {};
+        }
+        const uint64_t relay_sequence = next_sequence.fetch_add(1, std::memory_order_relaxed);
+        const sockaddr_in target_addr = members[target].addr;
+        relays.push_back(Relay{relay_sequence, sequence, source, Clock::now() + PERIOD});
+        send_to(encode(PING, relay_sequence, {}, false, protocol::MAX_REQUEST_SIZE), target_addr);
+    }
+    return {};
+}
+
+uint64_t Gossip::snapshot(std::vector<std::string>& names) const
+{
+    std::lock_guard lock(mutex);
+    names.clear();
+    for (const Member& member : members)
+    {
+        if (member.state != MemberState::DEAD)
+        {
+            names.push_back(member.name);
+        }
+    }
+    std::ranges::sort(names);
+
+    std::string joined;
+    for (const std::string& name : names)
+    {
+        joined += name;
+        joined += '|';
+    }
+    return HashRing::hash(joined);
+}
+
+void Gossip::send_to(const std::string& datagram, const sockaddr_in& addr) const
+{
+    sendto(socket_fd, datagram.data(), datagram.size(), 0, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+}
+
+int Gossip::next_probe_target()
+{
+    // Round-robin over a shuffled order bounds how long any member can go unprobed
+    for (size_t checked = 0; checked <= probe_order.size(); ++checked)
+    {
+        if (probe_cursor >= probe_order.size())
+        {
+            std::ranges::shuffle(probe_order, rng);
+            probe_cursor = 0;
+            if (probe_order.empty())
+            {
+                return -1;
+            }
+        }
+        const size_t candidate = probe_order[probe_cursor++];
+        if (members[candidate].state != MemberState::DEAD)
+        {
+            return static_cast<int>(candidate);
+        }
+    }
+    return -1;
+}
+
+void Gossip::expire_suspects(const Clock::time_point now)
+{
+    for (size_t i = 1; i < members.size(); ++i)
+    {
+        Member& member = members[i];
+        if (member.state == MemberState::SUSPECT && now - member.suspected_at >= SUSPECT_TIMEOUT)
+        {
+            member.state = MemberState::DEAD;
+            dead_count.fetch_add(1, std::memory_order_relaxed);
+            enqueue_update(i);
+        }
+    }
+    std::erase_if(relays, [now](const Relay& relay) { return relay.expires <= now; });
+}
+
+bool Gossip::await_ack(const uint64_t sequence, const Clock::time_point deadline)
+{
+    std::vector<char> buffer(protocol::MAX_RESPONSE_SIZE);
+    while (running.load(std::memory_order_relaxed))
+    {
+        const auto remaining = deadline - Clock::now();
+        if (remaining <= Clock::duration::zero())
+        {
+            return false;
+        }
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+        const timespec timeout{static_cast<time_t>(ns / 1'000'000'000), static_cast<long>(ns % 1'000'000'000)};
+        pollfd pfd{socket_fd, POLLIN, 0};
+        if (ppoll(&pfd, 1, &timeout, nullptr) <= 0)
+        {
+            continue;
+        }
+
+        ssize_t received;
+        while ((received = recv(socket_fd, buffer.data(), buffer.size(), MSG_DONTWAIT)) > 0)
+        {
+            protocol::Message message;
+            if (protocol::decode(std::string_view(buffer.data(), static_cast<size_t>(received)), message) == -1 ||
+                message.header.opcode != GOSSIP || message.header.flags != ACK)
+            {
+                continue;
+            }
+
+            std::lock_guard lock(mutex);
+            absorb(message.value);
+            if (message.header.request_id == sequence)
+            {
+                return true;
+            }
+
+            // An ACK for a probe made on someone else's behalf goes back to them under their sequence number
+            const auto relay = std::ranges::find(relays, message.header.request_id, &Relay::sequence);
+            if (relay != relays.end())
+            {
+                send_to(encode(ACK, relay->requester_sequence, {}, false, protocol::MAX_RESPONSE_SIZE), relay->requester);
+                relays.erase(relay);
+            }
+        }
+    }
+    return false;
+}
+
+void Gossip::run()
+{
+    while (running.load(std::memory_order_relaxed))
+    {
+        const auto period_start = Clock::now();
+        const auto period_end = period_start + PERIOD;
+        const uint64_t sequence = next_sequence.fetch_add(1, std::memory_order_relaxed);
+
+        // handle() may grow members on an executor thread, so the target's address is copied out
+        int target;
+        sockaddr_in target_addr{};
+        std::string ping;
+        {
+            std::lock_guard lock(mutex);
+            expire_suspects(period_start);
+            target = next_probe_target();
+            if (target != -1)
+            {
+                target_addr = members[target].addr;
+            }
+            ping = encode(PING, sequence, {}, false, protocol::MAX_REQUEST_SIZE);
+        }
+
+        if (target == -1)
+        {
+            // Nobody known yet (or everyone is dead): knock on the seeds until one answers
+            for (const sockaddr_in& seed : seeds)
+            {
+                send_to(ping, seed);
+            }
+            await_ack(sequence, period_end);
+            continue;
+        }
+
+        send_to(ping, target_addr);
+        bool acked = await_ack(sequence, period_start + PING_TIMEOUT);
+
+        if (!acked)
+        {
+            // Ask a few others to try, in case only the path from here is lossy
+            std::string request;
+            std::vector<sockaddr_in> helpers;
+            {
+                std::lock_guard lock(mutex);
+                std::vector<size_t> candidates;
+                for (size_t i = 1; i < members.size(); ++i)
+                {
+                    if (static_cast<int>(i) != target && members[i].state == MemberState::ALIVE)
+                    {
+                        candidates.push_back(i);
+                    }
+                }
+                std::ranges::shuffle(candidates, rng);
+                for (size_t i = 0; i < candidates.size() && i < INDIRECT_PROBES; ++i)
+                {
+                    helpers.push_back(members[candidates[i]].addr);
+                }
+                request = encode(PING_REQ, sequence, members[target].name, false, protocol::MAX_REQUEST_SIZE);
+            }
+            for (const sockaddr_in& helper : helpers)
+            {
+                send_to(request, helper);
+            }
+            acked = await_ack(sequence, period_end);
+        }
+
+        if (!acked)
+        {
+            std::lock_guard lock(mutex);
+            const Member& member = members[target];
+            if (member.state == MemberState::ALIVE)
+            {
+                apply(member.name, MemberState::SUSPECT, member.incarnation);
+            }
+        }
+
+        // Keep relaying ACKs for others until the period is over
+        await_ack(0, period_end);
+    }
+}
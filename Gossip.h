@@ -0,0 +1,127 @@
+#ifndef DISTIBUTED_HASH_TABLE_GOSSIP_H
+#define DISTIBUTED_HASH_TABLE_GOSSIP_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+
+#include "Protocol.h"
+
+enum class MemberState : uint8_t
+{
+    ALIVE = 0,
+    SUSPECT = 1,  // Missed a probe; declared DEAD unless it refutes in time
+    DEAD = 2,
+};
+
+// SWIM-style membership and failure detection between servers. Every PERIOD one member is probed
+// round-robin with a PING; without an ACK inside PING_TIMEOUT, INDIRECT_PROBES other members are
+// asked to probe it too (PING_REQ). A member silent for a whole period becomes SUSPECT, and DEAD
+// after SUSPECT_TIMEOUT unless it refutes by raising its incarnation. Membership changes ride along
+// on every message, so they spread in O(log n) periods without any extra traffic.
+//
+// PINGs and PING_REQs arrive on the server socket as GOSSIP requests (see handle()); probes and
+// the ACKs they collect use the gossip thread's own socket.
+class Gossip
+{
+public:
+    enum MessageType : uint8_t  // Carried in the header flags of GOSSIP messages
+    {
+        PING = 0,
+        ACK = 1,
+        PING_REQ = 2,  // Key names the member to probe on the sender's behalf
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr std::chrono::milliseconds PERIOD{100};
+    static constexpr std::chrono::milliseconds PING_TIMEOUT{30};
+    static constexpr std::chrono::milliseconds SUSPECT_TIMEOUT{500};
+    static constexpr size_t INDIRECT_PROBES = 2;
+    static constexpr size_t MAX_PIGGYBACK = 8;      // Updates per message
+    static constexpr unsigned RETRANSMIT_MULT = 3;  // Each update is sent RETRANSMIT_MULT * log2(n) times
+
+    struct Member
+    {
+        std::string name;  // "ip:port" of its server socket
+        sockaddr_in addr{};
+        MemberState state = MemberState::ALIVE;
+        uint64_t incarnation = 0;
+        Clock::time_point suspected_at;
+    };
+
+    struct Update
+    {
+        size_t member;  // Index into members; the member's current state is what gets sent
+        unsigned transmissions = 0;
+    };
+
+    // A PING sent for someone else's PING_REQ; its ACK is passed back under their sequence number
+    struct Relay
+    {
+        uint64_t sequence;
+        uint64_t requester_sequence;
+        sockaddr_in requester;
+        Clock::time_point expires;
+    };
+
+    std::vector<sockaddr_in> seeds;
+    int socket_fd = -1;
+
+    mutable std::mutex mutex;      // Everything below; handle() runs on executor threads
+    std::vector<Member> members;   // members[0] is this server
+    std::deque<Update> updates;
+    std::vector<Relay> relays;
+    std::vector<size_t> probe_order;
+    size_t probe_cursor = 0;
+    std::mt19937 rng{std::random_device{}()};
+
+    std::atomic<uint64_t> next_sequence{1};
+    std::thread worker;
+    std::atomic<bool> running{false};
+
+    std::atomic<uint64_t> suspected_count{0};
+    std::atomic<uint64_t> dead_count{0};
+
+    void run();
+    size_t find(std::string_view name) const;
+    void apply(std::string_view name, MemberState state, uint64_t incarnation);
+    void enqueue_update(size_t member);
+    std::string encode(MessageType type, uint64_t sequence, std::string_view key, bool full_state, size_t limit);
+    void absorb(std::string_view packed);
+    int next_probe_target();
+    bool await_ack(uint64_t sequence, Clock::time_point deadline);
+    void send_to(const std::string& datagram, const sockaddr_in& addr) const;
+    void expire_suspects(Clock::time_point now);
+
+public:
+    Gossip(std::string self_name, std::vector<sockaddr_in> seeds);
+    ~Gossip();
+    Gossip(const Gossip&) = delete;
+    Gossip& operator=(const Gossip&) = delete;
+
+    int start();
+    // Only flips a flag, so it is safe from a signal handler
+    void stop();
+    void join();
+
+    // Handles a GOSSIP request from the server socket; returns the ACK to send back, or nothing
+    std::string handle(uint8_t type, uint64_t sequence, std::string_view key, std::string_view packed,
+                       const sockaddr_in& source);
+    // Names of the members not known to be dead, sorted, and a version that every server with the
+    // same view agrees on, so clients can tell whether their ring is current
+    uint64_t snapshot(std::vector<std::string>& names) const;
+
+    uint64_t get_suspected_count() const { return suspected_count.load(); }
+    uint64_t get_dead_count() const { return dead_count.load(); }
+};
+
+#endif //DISTIBUTED_HASH_TABLE_GOSSIP_H
@@ -0,0 +1,85 @@
+#include "HashRing.h"
+
+#include <algorithm>
+#include <string>
+
+HashRing::HashRing(const size_t vnodes) : vnodes(std::max<size_t>(vnodes, 1)) {}
+
+uint64_t HashRing::hash(const std::string_view bytes)
+{
+    // FNV-1a over the bytes, then the murmur3 finalizer to spread short keys across the ring
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (const char c : bytes)
+    {
+        h ^= static_cast<uint8_t>(c);
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+void HashRing::add_node(const uint32_t node, const std::string_view name)
+{
+    remove_node(node);
+
+    std::string point_name(name);
+    point_name += '#';
+    const size_t prefix = point_name.size();
+    for (size_t i = 0; i < vnodes; ++i)
+    {
+        point_name.resize(prefix);
+        point_name += std::to_string(i);
+        points.push_back(Point{hash(point_name), node});
+    }
+
+    // Ties are broken by node id so every process builds the same ring
+    std::ranges::sort(points, [](const Point& a, const Point& b) {
+        return a.hash != b.hash ? a.hash < b.hash : a.node < b.node;
+    });
+    ++num_nodes;
+}
+
+void HashRing::remove_node(const uint32_t node)
+{
+    const auto removed = std::ranges::remove(points, node, &Point::node);
+    if (!removed.empty())
+    {
+        points.erase(removed.begin(), removed.end());
+        --num_nodes;
+    }
+}
+
+size_t HashRing::successor(const uint64_t hash) const
+{
+    const auto it = std::ranges::lower_bound(points, hash, {}, &Point::hash);
+    return it == points.end() ? 0 : static_cast<size_t>(it - points.begin());
+}
+
+uint32_t HashRing::owner(const std::string_view key) const
+{
+    return points[successor(hash(key))].node;
+}
+
+void HashRing::owners(const std::string_view key, const size_t count, std::vector<uint32_t>& out) const
+{
+    out.clear();
+    if (points.empty())
+    {
+        return;
+    }
+
+    const size_t wanted = std::min(count, num_nodes);
+    const size_t start = successor(hash(key));
+    for (size_t i = 0; i < points.size() && out.size() < wanted; ++i)
+    {
+        const uint32_t node = points[(start + i) % points.size()].node;
+        if (std::ranges::find(out, node) == out.end())
+        {
+            out.push_back(node);
+        }
+    }
+}
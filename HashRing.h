@@ -0,0 +1,46 @@
+#ifndef DISTIBUTED_HASH_TABLE_HASHRING_H
+#define DISTIBUTED_HASH_TABLE_HASHRING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Consistent-hash ring shared by clients and servers. Every node is placed at `vnodes`
+// points derived from its name (e.g. "10.0.0.1:1895"), so placement does not depend on the
+// order nodes are added in, and adding or removing a node only moves the keys next to its
+// points. Not thread-safe; rebuild or guard it externally when membership changes.
+class HashRing
+{
+    struct Point
+    {
+        uint64_t hash;
+        uint32_t node;
+    };
+
+    std::vector<Point> points;  // Sorted by hash
+    size_t vnodes;
+    size_t num_nodes = 0;
+
+    size_t successor(uint64_t hash) const;
+
+public:
+    static constexpr size_t DEFAULT_VNODES = 128;
+
+    explicit HashRing(size_t vnodes = DEFAULT_VNODES);
+
+    void add_node(uint32_t node, std::string_view name);
+    void remove_node(uint32_t node);
+    size_t size() const { return num_nodes; }
+    bool empty() const { return points.empty(); }
+
+    // Node owning the key; the ring must not be empty
+    uint32_t owner(std::string_view key) const;
+    // Up to count distinct nodes walking clockwise from the key, owner first
+    void owners(std::string_view key, size_t count, std::vector<uint32_t>& out) const;
+
+    // 64-bit hash of raw bytes; identical on every platform so all processes agree on placement
+    static uint64_t hash(std::string_view bytes);
+};
+
+#endif //DISTIBUTED_HASH_TABLE_HASHRING_H
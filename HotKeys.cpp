@@ -0,0 +1,81 @@
+#include "HotKeys.h"
+
+#include <algorithm>
+
+bool HotKeySet::contains(const uint64_t hash) const
+{
+    return std::ranges::binary_search(hashes, hash);
+}
+
+bool HotKeySet::is_spread(const uint64_t hash) const
+{
+    return std::ranges::binary_search(spread, hash);
+}
+
+void HotKeySampler::observe(const std::string_view key, const uint64_t hash)
+{
+    // Rows are indexed by h1 + row * h2 (Kirsch-Mitzenmacher), so one 64-bit hash serves them all
+    const auto h1 = static_cast<uint32_t>(hash);
+    const auto h2 = static_cast<uint32_t>(hash >> 32) | 1;
+
+    std::lock_guard lock(mutex);
+    ++sampled;
+    uint32_t estimate = UINT32_MAX;
+    for (size_t row = 0; row < DEPTH; ++row)
+    {
+        uint32_t& count = counts[row][(h1 + row * h2) % WIDTH];
+        if (count < UINT32_MAX)
+        {
+            ++count;
+        }
+        estimate = std::min(estimate, count);
+    }
+
+    const auto found = std::ranges::find(candidates, key, [](const auto& candidate) -> std::string_view {
+        return candidate.first;
+    });
+    if (found != candidates.end())
+    {
+        found->second = estimate;
+        return;
+    }
+    if (candidates.size() < CANDIDATES)
+    {
+        candidates.emplace_back(key, estimate);
+        return;
+    }
+
+    // Full: a key displaces the coldest candidate once its estimate overtakes it
+    const auto coldest = std::ranges::min_element(candidates, {}, &std::pair<std::string, uint32_t>::second);
+    if (estimate > coldest->second)
+    {
+        coldest->first.assign(key);
+        coldest->second = estimate;
+    }
+}
+
+uint64_t HotKeySampler::harvest(std::vector<std::pair<std::string, uint64_t>>& out)
+{
+    std::lock_guard lock(mutex);
+    for (const auto& [key, estimate] : candidates)
+    {
+        out.emplace_back(key, estimate);
+    }
+    const uint64_t total = sampled;
+
+    // Halving ages everything at once; candidates that fade to nothing make room for new ones
+    for (auto& row : counts)
+    {
+        for (uint32_t& count : row)
+        {
+            count >>= 1;
+        }
+    }
+    for (auto& candidate : candidates)
+    {
+        candidate.second >>= 1;
+    }
+    std::erase_if(candidates, [](const auto& candidate) { return candidate.second == 0; });
+    sampled >>= 1;
+    return total;
+}
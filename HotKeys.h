@@ -0,0 +1,65 @@
+#ifndef DISTIBUTED_HASH_TABLE_HOTKEYS_H
+#define DISTIBUTED_HASH_TABLE_HOTKEYS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <netinet/in.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Heavy hitters merged from every thread's sampler; published as an immutable snapshot
+struct HotKeySet
+{
+    std::vector<std::pair<std::string, uint64_t>> top;  // Hottest first, with estimated requests per second
+    std::vector<uint64_t> hashes;                       // Sorted HashRing::hash of the keys hot enough to hint
+    uint64_t sampled = 0;                               // Estimated single-key requests per second, all keys
+    std::vector<uint64_t> spread;                       // Sorted hashes of the keys copied to peers
+    std::vector<sockaddr_in> peers;                     // Live servers other than this one
+
+    bool contains(uint64_t hash) const;
+    bool is_spread(uint64_t hash) const;
+};
+
+// Read-only copies of other servers' hot keys, keyed by key; also published as a snapshot
+struct HotKeyCopy
+{
+    std::string value;
+    uint64_t expires_ns = 0;  // LatencyHistogram::now_ns
+};
+using HotKeyCopies = std::unordered_map<std::string, HotKeyCopy>;
+
+// Per-thread sampler of request keys. One request in 2^SAMPLE_SHIFT is counted in a count-min
+// sketch, and the sampled keys with the highest estimates are kept as heavy-hitter candidates.
+// The owning thread calls observe(); harvest() may run on any thread and halves the counts, so
+// traffic fades out after a few harvests and the candidates follow the current workload.
+class HotKeySampler
+{
+public:
+    static constexpr unsigned SAMPLE_SHIFT = 4;  // 1 in 16 requests
+    static constexpr size_t DEPTH = 4;
+    static constexpr size_t WIDTH = 2048;        // Overestimates stay below ~2/WIDTH of the sampled traffic
+    static constexpr size_t CANDIDATES = 32;
+
+    // Owner thread only; cheap unless this request is sampled
+    bool should_sample() { return (++requests & ((uint64_t{1} << SAMPLE_SHIFT) - 1)) == 0; }
+    void observe(std::string_view key, uint64_t hash);
+
+    // Appends this sampler's candidates with their sampled counts to out and returns how many
+    // requests it sampled, then halves everything
+    uint64_t harvest(std::vector<std::pair<std::string, uint64_t>>& out);
+
+private:
+    uint64_t requests = 0;  // Owner thread only
+
+    std::mutex mutex;  // The rest; only contended while harvesting
+    std::array<std::array<uint32_t, WIDTH>, DEPTH> counts{};
+    std::vector<std::pair<std::string, uint32_t>> candidates;
+    uint64_t sampled = 0;
+};
+
+#endif //DISTIBUTED_HASH_TABLE_HOTKEYS_H
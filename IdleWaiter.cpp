@@ -0,0 +1,22 @@
+#include "IdleWaiter.h"
+
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be a plain 32-bit integer");
+
+void IdleWaiter::park(const uint32_t expected)
+{
+    // Bounded so a missed wake-up (or shutdown) costs at most one timeout
+    timespec timeout{};
+    timeout.tv_sec = 0;
+    timeout.tv_nsec = 50'000'000;  // 50ms
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch), FUTEX_WAIT_PRIVATE, expected, &timeout, nullptr, 0);
+}
+
+void IdleWaiter::wake(const int count)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
@@ -0,0 +1,100 @@
+#ifndef DISTIBUTED_HASH_TABLE_IDLEWAITER_H
+#define DISTIBUTED_HASH_TABLE_IDLEWAITER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+enum class WaitPolicy
+{
+    SLEEP,     // Fixed 10us sleep per empty poll (the original behaviour)
+    SPIN,      // Busy-spin then yield, never parks
+    ADAPTIVE,  // Bounded spin, then yield, then futex park until a producer wakes us
+    BLOCKING,  // Parks as soon as the queue is empty
+};
+
+// Idle strategy for consumers of the moodycamel queues. Consumers call wait() after an
+// empty dequeue; producers call notify() after enqueueing, which only costs a syscall
+// when somebody is actually parked.
+class IdleWaiter
+{
+    static constexpr unsigned SPIN_ROUNDS = 64;
+    static constexpr unsigned YIELD_ROUNDS = 16;
+
+    WaitPolicy policy;
+    std::atomic<uint32_t> epoch{0};
+    std::atomic<uint32_t> sleepers{0};
+
+    void park(uint32_t expected);
+    void wake(int count);
+
+    static void cpu_relax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+public:
+    explicit IdleWaiter(const WaitPolicy policy = WaitPolicy::ADAPTIVE) : policy(policy) {}
+
+    // idle_rounds counts consecutive empty polls and must be reset by the caller once it finds work
+    template <typename HasWork>
+    void wait(unsigned& idle_rounds, HasWork&& has_work)
+    {
+        const unsigned round = idle_rounds++;
+
+        switch (policy)
+        {
+            case WaitPolicy::SLEEP:
+                std::this_thread::sleep_for(std::chrono::microseconds(10));
+                return;
+            case WaitPolicy::SPIN:
+            case WaitPolicy::ADAPTIVE:
+                if (round < SPIN_ROUNDS)
+                {
+                    cpu_relax();
+                    return;
+                }
+                if (policy == WaitPolicy::SPIN || round < SPIN_ROUNDS + YIELD_ROUNDS)
+                {
+                    std::this_thread::yield();
+                    return;
+                }
+                break;
+            case WaitPolicy::BLOCKING:
+                break;
+        }
+
+        // Announce ourselves before the final check so a producer enqueueing concurrently sees us
+        const uint32_t expected = epoch.load(std::memory_order_acquire);
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        if (!has_work())
+        {
+            park(expected);
+        }
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // One parked consumer is enough per batch; it drains in bulk
+    void notify()
+    {
+        epoch.fetch_add(1, std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_seq_cst) > 0)
+        {
+            wake(1);
+        }
+    }
+
+    // Used at shutdown; only touches the futex word, so it is safe from a signal handler
+    void notify_all()
+    {
+        epoch.fetch_add(1, std::memory_order_seq_cst);
+        wake(INT32_MAX);
+    }
+};
+
+#endif //DISTIBUTED_HASH_TABLE_IDLEWAITER_H
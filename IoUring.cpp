@@ -0,0 +1,174 @@
+#include "IoUring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+IoUring::~IoUring()
+{
+    release();
+}
+
+void IoUring::release()
+{
+    if (sqes != nullptr)
+    {
+        munmap(sqes, sqes_size);
+        sqes = nullptr;
+    }
+    if (cq_ring != nullptr && cq_ring != sq_ring)
+    {
+        munmap(cq_ring, cq_ring_size);
+    }
+    cq_ring = nullptr;
+    if (sq_ring != nullptr)
+    {
+        munmap(sq_ring, sq_ring_size);
+        sq_ring = nullptr;
+    }
+    if (ring_fd != -1)
+    {
+        close(ring_fd);
+        ring_fd = -1;
+    }
+}
+
+int IoUring::init(const unsigned entries, const unsigned cq_entries)
+{
+    io_uring_params params{};
+    if (cq_entries != 0)
+    {
+        params.flags |= IORING_SETUP_CQSIZE;
+        params.cq_entries = cq_entries;
+    }
+
+    ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (ring_fd == -1)
+    {
+        return -1;
+    }
+
+    // Completion-driven waits with a deadline need IORING_ENTER_EXT_ARG
+    if ((params.features & IORING_FEAT_EXT_ARG) == 0)
+    {
+        release();
+        return -1;
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap)
+    {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED)
+    {
+        sq_ring = nullptr;
+        release();
+        return -1;
+    }
+
+    if (single_mmap)
+    {
+        cq_ring = sq_ring;
+    }
+    else
+    {
+        cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED)
+        {
+            cq_ring = nullptr;
+            release();
+            return -1;
+        }
+    }
+
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes_ptr = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring_fd, IORING_OFF_SQES);
+    if (sqes_ptr == MAP_FAILED)
+    {
+        release();
+        return -1;
+    }
+    sqes = static_cast<io_uring_sqe*>(sqes_ptr);
+
+    auto* sq = static_cast<char*>(sq_ring);
+    sq_khead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_ktail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_entries = params.sq_entries;
+
+    auto* cq = static_cast<char*>(cq_ring);
+    cq_khead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_ktail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+
+    sqe_tail = sqe_submitted = *sq_ktail;
+    return 0;
+}
+
+io_uring_sqe* IoUring::get_sqe()
+{
+    const unsigned head = std::atomic_ref(*sq_khead).load(std::memory_order_acquire);
+    if (sqe_tail - head >= sq_entries)
+    {
+        return nullptr;
+    }
+
+    const unsigned index = sqe_tail & sq_mask;
+    io_uring_sqe* sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    ++sqe_tail;
+    return sqe;
+}
+
+unsigned IoUring::withdraw()
+{
+    // Without SQPOLL the kernel only consumes SQEs inside io_uring_enter, so the tail can be rewound
+    const unsigned head = std::atomic_ref(*sq_khead).load(std::memory_order_acquire);
+    const unsigned withdrawn = sqe_tail - head;
+    sqe_tail = sqe_submitted = head;
+    std::atomic_ref(*sq_ktail).store(head, std::memory_order_release);
+    return withdrawn;
+}
+
+int IoUring::submit(const unsigned wait_nr, const long long timeout_ns)
+{
+    const unsigned to_submit = sqe_tail - sqe_submitted;
+    std::atomic_ref(*sq_ktail).store(sqe_tail, std::memory_order_release);
+    sqe_submitted = sqe_tail;
+
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    __kernel_timespec ts{};
+    io_uring_getevents_arg arg{};
+    void* arg_ptr = nullptr;
+    size_t arg_size = 0;
+
+    if (wait_nr > 0 && timeout_ns > 0)
+    {
+        ts.tv_sec = timeout_ns / 1000000000LL;
+        ts.tv_nsec = timeout_ns % 1000000000LL;
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = reinterpret_cast<__u64>(&ts);
+        arg_ptr = &arg;
+        arg_size = sizeof(arg);
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+
+    const long result = syscall(__NR_io_uring_enter, ring_fd, to_submit, wait_nr, flags, arg_ptr, arg_size);
+    return result == -1 ? -errno : static_cast<int>(result);
+}
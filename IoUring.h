@@ -0,0 +1,82 @@
+#ifndef DISTIBUTED_HASH_TABLE_IOURING_H
+#define DISTIBUTED_HASH_TABLE_IOURING_H
+
+#include <atomic>
+#include <cstddef>
+#include <linux/io_uring.h>
+
+// <linux/fs.h>, pulled in by <linux/io_uring.h>, defines BLOCK_SIZE, which clashes with moodycamel's traits
+#undef BLOCK_SIZE
+
+// Minimal io_uring wrapper over the raw syscalls (no liburing dependency).
+// Not thread-safe: each ring is owned by the thread that drives it.
+class IoUring
+{
+    int ring_fd = -1;
+
+    void* sq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    void* cq_ring = nullptr;
+    size_t cq_ring_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+
+    unsigned* sq_khead = nullptr;
+    unsigned* sq_ktail = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned sq_mask = 0;
+    unsigned sq_entries = 0;
+
+    unsigned* cq_khead = nullptr;
+    unsigned* cq_ktail = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    unsigned cq_mask = 0;
+
+    unsigned sqe_tail = 0;     // Next SQE handed out by get_sqe()
+    unsigned sqe_submitted = 0;
+
+    void release();
+
+public:
+    IoUring() = default;
+    ~IoUring();
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    int init(unsigned entries, unsigned cq_entries = 0);
+    bool ready() const { return ring_fd != -1; }
+
+    // Returns nullptr when the submission queue is full
+    io_uring_sqe* get_sqe();
+
+    // Publishes pending SQEs and optionally waits for wait_nr completions.
+    // timeout_ns == 0 waits without a deadline. Returns -errno on failure.
+    int submit(unsigned wait_nr = 0, long long timeout_ns = 0);
+
+    // Takes back the SQEs a failed submit left in the ring unconsumed, so they cannot be picked up
+    // later with stale pointers; returns how many
+    unsigned withdraw();
+
+    // Unmaps the ring and closes it; ready() is false afterwards
+    void teardown() { release(); }
+
+    template <typename F>
+    unsigned drain(F&& on_cqe)
+    {
+        unsigned head = *cq_khead;
+        const unsigned tail = std::atomic_ref(*cq_ktail).load(std::memory_order_acquire);
+        unsigned seen = 0;
+
+        while (head != tail)
+        {
+            on_cqe(cqes[head & cq_mask]);
+            ++head;
+            ++seen;
+        }
+
+        std::atomic_ref(*cq_khead).store(head, std::memory_order_release);
+        return seen;
+    }
+};
+
+#endif //DISTIBUTED_HASH_TABLE_IOURING_H
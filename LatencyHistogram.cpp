@@ -0,0 +1,73 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <bit>
+
+size_t LatencyHistogram::bucket(const uint64_t ns)
+{
+    if (ns < SUB_COUNT)
+    {
+        return static_cast<size_t>(ns);
+    }
+
+    // The top SUB_BITS + 1 bits of the value pick the bucket; the rest is the precision given up
+    const unsigned shift = static_cast<unsigned>(std::bit_width(ns)) - (SUB_BITS + 1);
+    const size_t index = (shift + 1) * SUB_COUNT + static_cast<size_t>((ns >> shift) - SUB_COUNT);
+    return std::min(index, BUCKETS - 1);
+}
+
+uint64_t LatencyHistogram::bucket_upper(const size_t index)
+{
+    if (index < SUB_COUNT)
+    {
+        return index;
+    }
+
+    const unsigned shift = static_cast<unsigned>(index / SUB_COUNT) - 1;
+    const uint64_t sub = index % SUB_COUNT;
+    return ((SUB_COUNT + sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::merge_into(Counts& totals) const
+{
+    for (size_t i = 0; i < BUCKETS; ++i)
+    {
+        totals[i] += counts[i].load(std::memory_order_relaxed);
+    }
+}
+
+LatencyHistogram::Summary LatencyHistogram::summarize(const Counts& totals)
+{
+    Summary summary;
+    for (const uint64_t count : totals)
+    {
+        summary.count += count;
+    }
+    if (summary.count == 0)
+    {
+        return summary;
+    }
+
+    // Rank thresholds, rounded up so p99 of 100 samples is the 99th and not the 98th
+    const auto rank = [&summary](const uint64_t per_mille) { return (summary.count * per_mille + 999) / 1000; };
+    const std::array<std::pair<uint64_t, uint64_t*>, 4> targets{{
+        {rank(500), &summary.p50}, {rank(900), &summary.p90}, {rank(990), &summary.p99}, {rank(999), &summary.p999}}};
+
+    uint64_t seen = 0;
+    size_t next = 0;
+    for (size_t i = 0; i < BUCKETS; ++i)
+    {
+        if (totals[i] == 0)
+        {
+            continue;
+        }
+        seen += totals[i];
+        while (next < targets.size() && seen >= targets[next].first)
+        {
+            *targets[next].second = bucket_upper(i);
+            ++next;
+        }
+        summary.max = bucket_upper(i);
+    }
+    return summary;
+}
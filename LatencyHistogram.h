@@ -0,0 +1,58 @@
+#ifndef DISTIBUTED_HASH_TABLE_LATENCYHISTOGRAM_H
+#define DISTIBUTED_HASH_TABLE_LATENCYHISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Log-linear histogram of nanosecond latencies in the style of HdrHistogram: values below
+// 2 * SUB_COUNT are exact, and every power of two above that is split into SUB_COUNT buckets, so
+// a reported percentile is within ~3% of the true one. Values past MAX_BITS land in the last bucket.
+//
+// Meant to be owned by one recording thread: record() is a relaxed add with no contention, and
+// any thread may merge a snapshot at any time.
+class LatencyHistogram
+{
+public:
+    static constexpr unsigned SUB_BITS = 5;
+    static constexpr size_t SUB_COUNT = size_t{1} << SUB_BITS;
+    static constexpr unsigned MAX_BITS = 40;  // ~18 minutes
+    static constexpr size_t BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_COUNT;
+
+    using Counts = std::array<uint64_t, BUCKETS>;
+
+    struct Summary
+    {
+        uint64_t count = 0;
+        uint64_t p50 = 0;  // Nanoseconds, each the upper edge of its bucket
+        uint64_t p90 = 0;
+        uint64_t p99 = 0;
+        uint64_t p999 = 0;
+        uint64_t max = 0;
+    };
+
+    void record(const uint64_t ns)
+    {
+        counts[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Adds this histogram's counts to totals
+    void merge_into(Counts& totals) const;
+
+    static Summary summarize(const Counts& totals);
+    static size_t bucket(uint64_t ns);
+    static uint64_t bucket_upper(size_t index);
+
+    static uint64_t now_ns()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> counts{};
+};
+
+#endif //DISTIBUTED_HASH_TABLE_LATENCYHISTOGRAM_H
@@ -0,0 +1,418 @@
+#include "NetIo.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <arpa/inet.h>
+#include <linux/filter.h>
+
+namespace
+{
+constexpr int MAX_SEND_RETRIES = 3;
+
+bool is_transient(const int err)
+{
+    return err == EAGAIN || err == EWOULDBLOCK || err == ENOBUFS || err == EINTR;
+}
+}
+
+void prepare_send(ResponseEntry* responses, const size_t count, iovec* iovecs, mmsghdr* msgs)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        ResponseEntry& resp = responses[i];
+        iovecs[i].iov_base = resp.response.data();
+        iovecs[i].iov_len = resp.response.size();
+        msgs[i].msg_hdr = msghdr{};
+        msgs[i].msg_hdr.msg_name = &resp.client_addr;
+        msgs[i].msg_hdr.msg_namelen = sizeof(resp.client_addr);
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+std::string endpoint_name(const sockaddr_in& addr)
+{
+    char ip[INET_ADDRSTRLEN] = {};
+    inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+    return std::string(ip) + ":" + std::to_string(ntohs(addr.sin_port));
+}
+
+int parse_endpoint(const std::string_view endpoint, const uint16_t default_port, sockaddr_in& addr)
+{
+    addr = sockaddr_in{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(default_port);
+
+    std::string_view ip = endpoint;
+    if (const size_t colon = endpoint.rfind(':'); colon != std::string_view::npos)
+    {
+        ip = endpoint.substr(0, colon);
+        const std::string_view port = endpoint.substr(colon + 1);
+        unsigned int value = 0;
+        const auto [end, ec] = std::from_chars(port.data(), port.data() + port.size(), value);
+        if (ec != std::errc{} || end != port.data() + port.size() || value == 0 || value > UINT16_MAX)
+        {
+            return -1;
+        }
+        addr.sin_port = htons(static_cast<uint16_t>(value));
+    }
+
+    const std::string ip_str(ip);
+    return inet_pton(AF_INET, ip_str.c_str(), &addr.sin_addr) == 1 ? 0 : -1;
+}
+
+uint32_t steer_hash(const std::string_view key)
+{
+    uint32_t hash = 2166136261u;
+    for (const char c : key.substr(0, STEER_KEY_BYTES))
+    {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+int attach_key_steering(const int fd, const size_t num_sockets)
+{
+    // Anything at or past the group size makes the kernel fall back to its flow hash
+    constexpr uint32_t UNSTEERED = UINT32_MAX;
+    constexpr uint32_t KEY_LEN = 0;  // Scratch memory slots
+    constexpr uint32_t KEY_OFFSET = 1;
+    constexpr uint32_t HASH = 2;
+
+    std::vector<sock_filter> program;
+    const auto op = [&program](const uint16_t code, const uint32_t k) { program.push_back(BPF_STMT(code, k)); };
+    const auto jump = [&program](const uint16_t code, const uint32_t k, const uint8_t jt, const uint8_t jf) {
+        program.push_back(BPF_JUMP(code, k, jt, jf));
+    };
+    // Continues if A == k (or A > k), otherwise leaves the datagram to the flow hash
+    const auto require = [&](const uint16_t code, const uint32_t k) {
+        jump(BPF_JMP | code | BPF_K, k, 1, 0);
+        op(BPF_RET | BPF_K, UNSTEERED);
+    };
+    // A = the little-endian u16 at offset
+    const auto load_u16 = [&](const uint32_t offset) {
+        op(BPF_LD | BPF_B | BPF_ABS, offset + 1);
+        op(BPF_ALU | BPF_LSH | BPF_K, 8);
+        op(BPF_MISC | BPF_TAX, 0);
+        op(BPF_LD | BPF_B | BPF_ABS, offset);
+        op(BPF_ALU | BPF_OR | BPF_X, 0);
+    };
+    const auto finish = [&] {
+        op(BPF_LD | BPF_MEM, HASH);
+        op(BPF_ALU | BPF_MOD | BPF_K, static_cast<uint32_t>(num_sockets));
+        op(BPF_RET | BPF_A, 0);
+    };
+
+    // UDP hands the filter the payload. A wakeup names its socket in its only byte.
+    op(BPF_LD | BPF_W | BPF_LEN, 0);
+    jump(BPF_JMP | BPF_JEQ | BPF_K, 1, 0, 2);
+    op(BPF_LD | BPF_B | BPF_ABS, 0);
+    op(BPF_RET | BPF_A, 0);
+    require(BPF_JGE, protocol::HEADER_SIZE);
+    op(BPF_LD | BPF_B | BPF_ABS, 0);
+    require(BPF_JEQ, protocol::MAGIC);
+
+    op(BPF_LD | BPF_B | BPF_ABS, 1);
+    jump(BPF_JMP | BPF_JEQ | BPF_K, GET, 4, 0);
+    jump(BPF_JMP | BPF_JEQ | BPF_K, PUT, 3, 0);
+    jump(BPF_JMP | BPF_JEQ | BPF_K, VGET, 2, 0);
+    jump(BPF_JMP | BPF_JEQ | BPF_K, VPUT, 1, 0);
+    op(BPF_RET | BPF_K, UNSTEERED);
+
+    load_u16(4);
+    op(BPF_ST, KEY_LEN);
+    load_u16(6);
+    op(BPF_ALU | BPF_ADD | BPF_K, protocol::HEADER_SIZE);
+    op(BPF_ST, KEY_OFFSET);
+    op(BPF_LD | BPF_IMM, 2166136261u);
+    op(BPF_ST, HASH);
+
+    // steer_hash unrolled, since classic BPF cannot loop
+    for (uint32_t i = 0; i < STEER_KEY_BYTES; ++i)
+    {
+        op(BPF_LD | BPF_MEM, KEY_LEN);
+        jump(BPF_JMP | BPF_JGT | BPF_K, i, 3, 0);
+        finish();
+        op(BPF_LDX | BPF_MEM, KEY_OFFSET);
+        op(BPF_LD | BPF_B | BPF_IND, i);
+        op(BPF_MISC | BPF_TAX, 0);
+        op(BPF_LD | BPF_MEM, HASH);
+        op(BPF_ALU | BPF_XOR | BPF_X, 0);
+        op(BPF_ALU | BPF_MUL | BPF_K, 16777619u);
+        op(BPF_ST, HASH);
+    }
+    finish();
+
+    const sock_fprog fprog{static_cast<unsigned short>(program.size()), program.data()};
+    return setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &fprog, sizeof(fprog)) == 0 ? 0 : -1;
+}
+
+SocketReceiver::SocketReceiver(const int fd, const size_t batch_size)
+    : fd(fd), buffers(batch_size), sources(batch_size), iovecs(batch_size), msgs(batch_size)
+{
+    for (size_t i = 0; i < batch_size; ++i)
+    {
+        iovecs[i].iov_base = buffers[i].data();
+        iovecs[i].iov_len = DATAGRAM_SIZE;
+        msgs[i].msg_hdr = msghdr{};
+        msgs[i].msg_hdr.msg_name = &sources[i];
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+int SocketReceiver::receive_batch()
+{
+    for (auto& msg : msgs)
+    {
+        msg.msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    }
+    return recvmmsg(fd, msgs.data(), static_cast<unsigned int>(msgs.size()), MSG_WAITFORONE, nullptr);
+}
+
+size_t SocketSender::send(mmsghdr* msgs, const size_t count)
+{
+    size_t next = 0;
+    size_t delivered = 0;
+    int retries = 0;
+
+    while (next < count)
+    {
+        const int result = sendmmsg(fd, msgs + next, static_cast<unsigned int>(count - next), 0);
+        syscall_count.fetch_add(1, std::memory_order_relaxed);
+
+        if (result > 0)
+        {
+            // Partial sends just resume from the first message the kernel did not take
+            next += static_cast<size_t>(result);
+            delivered += static_cast<size_t>(result);
+            retries = 0;
+            continue;
+        }
+
+        if (is_transient(errno) && retries++ < MAX_SEND_RETRIES)
+        {
+            continue;
+        }
+
+        // Drop the message the kernel keeps rejecting and carry on with the rest of the batch
+        ++next;
+        retries = 0;
+    }
+
+    return delivered;
+}
+
+int UringReceiver::init(const int fd, const size_t batch_size)
+{
+    this->fd = fd;
+
+    // Enough buffers that a burst can land while the previous batch is still being parsed
+    buf_count = std::bit_ceil(static_cast<unsigned>(std::clamp<size_t>(batch_size * 8, 64, 32768)));
+    buf_size = sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in) + DATAGRAM_SIZE;
+
+    // Recycled buffers are handed back one SQE each, so the SQ has to absorb a full batch of them
+    if (ring.init(std::bit_ceil(static_cast<unsigned>(std::max<size_t>(batch_size * 2, 64))), buf_count * 2) != 0)
+    {
+        return -1;
+    }
+
+    buffers.resize(buf_count * buf_size);
+
+    io_uring_sqe* sqe = ring.get_sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(buf_count);
+    sqe->addr = reinterpret_cast<__u64>(buffers.data());
+    sqe->len = static_cast<__u32>(buf_size);
+    sqe->off = 0;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = PROVIDE_TAG;
+
+    if (ring.submit(1) < 0)
+    {
+        return -1;
+    }
+
+    int provided = -1;
+    ring.drain([&provided](const io_uring_cqe& cqe) { provided = cqe.res; });
+    if (provided < 0)
+    {
+        return -1;
+    }
+
+    msg = msghdr{};
+    msg.msg_namelen = sizeof(sockaddr_in);
+    return 0;
+}
+
+int UringReceiver::arm()
+{
+    io_uring_sqe* sqe = ring.get_sqe();
+    if (sqe == nullptr)
+    {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<__u64>(&msg);
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = RECV_TAG;
+
+    armed = true;
+    return 0;
+}
+
+bool UringReceiver::decode(const unsigned short bid, const int length, std::string_view& payload,
+                           sockaddr_in& source) const
+{
+    const char* buf = buffers.data() + static_cast<size_t>(bid) * buf_size;
+    io_uring_recvmsg_out out{};
+
+    if (static_cast<size_t>(length) < sizeof(out))
+    {
+        return false;
+    }
+    std::memcpy(&out, buf, sizeof(out));
+
+    if ((out.flags & MSG_TRUNC) != 0 || out.namelen < sizeof(sockaddr_in))
+    {
+        return false;
+    }
+
+    // Layout: io_uring_recvmsg_out | name (msg_namelen) | control (msg_controllen) | payload
+    const char* name = buf + sizeof(out);
+    const char* data = name + msg.msg_namelen + msg.msg_controllen;
+    if (data + out.payloadlen > buf + length)
+    {
+        return false;
+    }
+
+    std::memcpy(&source, name, sizeof(source));
+    payload = std::string_view(data, out.payloadlen);
+    return true;
+}
+
+void UringReceiver::recycle(const unsigned short bid)
+{
+    io_uring_sqe* sqe = ring.get_sqe();
+    if (sqe == nullptr)
+    {
+        // Flush queued hand-backs without waiting to make room
+        ring.submit();
+        sqe = ring.get_sqe();
+        if (sqe == nullptr)
+        {
+            return;
+        }
+    }
+
+    // Goes out with the next submit, which is also the call that waits for more datagrams
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = 1;
+    sqe->addr = reinterpret_cast<__u64>(buffers.data() + static_cast<size_t>(bid) * buf_size);
+    sqe->len = static_cast<__u32>(buf_size);
+    sqe->off = bid;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = PROVIDE_TAG;
+}
+
+int UringSender::init(const int fd, const size_t batch_size, std::atomic<uint64_t>& syscall_count)
+{
+    this->fd = fd;
+    this->syscall_count = &syscall_count;
+    pending.reserve(batch_size);
+    failed.reserve(batch_size);
+    return ring.init(std::bit_ceil(static_cast<unsigned>(std::max<size_t>(batch_size, 8))));
+}
+
+size_t UringSender::send(mmsghdr* msgs, const size_t count)
+{
+    // The ring was torn down after a hard failure; the socket still works
+    if (!ring.ready())
+    {
+        return SocketSender(fd, *syscall_count).send(msgs, count);
+    }
+
+    size_t delivered = 0;
+    const auto on_cqe = [&](const io_uring_cqe& cqe) {
+        if (cqe.res >= 0)
+        {
+            ++delivered;
+        }
+        else if (is_transient(-cqe.res))
+        {
+            failed.push_back(static_cast<size_t>(cqe.user_data));
+        }
+    };
+
+    pending.clear();
+    for (size_t i = 0; i < count; ++i)
+    {
+        pending.push_back(i);
+    }
+
+    for (int attempt = 0; !pending.empty() && attempt <= MAX_SEND_RETRIES; ++attempt)
+    {
+        failed.clear();
+        size_t next = 0;
+
+        while (next < pending.size())
+        {
+            unsigned queued = 0;
+            while (next < pending.size())
+            {
+                io_uring_sqe* sqe = ring.get_sqe();
+                if (sqe == nullptr)
+                {
+                    break;
+                }
+                sqe->opcode = IORING_OP_SENDMSG;
+                sqe->fd = fd;
+                sqe->addr = reinterpret_cast<__u64>(&msgs[pending[next]].msg_hdr);
+                sqe->len = 1;
+                sqe->user_data = pending[next];
+                ++next;
+                ++queued;
+            }
+
+            unsigned reaped = 0;
+            while (reaped < queued)
+            {
+                const int result = ring.submit(queued - reaped);
+                syscall_count->fetch_add(1, std::memory_order_relaxed);
+                if (result < 0 && result != -EINTR)
+                {
+                    // SQEs the kernel never took are withdrawn, but the ones it did may still read msgs
+                    // and would complete into the next batch, so they are waited for before returning
+                    queued -= ring.withdraw();
+                    reaped += ring.drain(on_cqe);
+                    while (reaped < queued)
+                    {
+                        const int waited = ring.submit(queued - reaped);
+                        syscall_count->fetch_add(1, std::memory_order_relaxed);
+                        if (waited < 0 && waited != -EINTR)
+                        {
+                            ring.teardown();
+                            break;
+                        }
+                        reaped += ring.drain(on_cqe);
+                    }
+                    return delivered;
+                }
+
+                reaped += ring.drain(on_cqe);
+            }
+        }
+
+        pending.swap(failed);
+    }
+
+    return delivered;
+}
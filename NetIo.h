@@ -0,0 +1,179 @@
+#ifndef DISTIBUTED_HASH_TABLE_NETIO_H
+#define DISTIBUTED_HASH_TABLE_NETIO_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "IoUring.h"
+#include "Protocol.h"
+
+// Receivers expose receive(on_datagram), calling on_datagram(std::string_view payload,
+// const sockaddr_in& source) for every datagram; the payload is only valid during the call.
+// Senders expose send(msgs, count) and return how many datagrams were handed to the kernel.
+
+constexpr size_t DATAGRAM_SIZE = protocol::MAX_REQUEST_SIZE;
+
+struct ResponseEntry
+{
+    sockaddr_in client_addr{};
+    std::string response;
+    uint64_t queued_ns = 0;  // When the reply was produced (LatencyHistogram::now_ns); 0 if untimed
+
+    ResponseEntry() = default;
+    ResponseEntry(const sockaddr_in& addr, std::string resp)
+        : client_addr(addr), response(std::move(resp)) {}
+};
+
+// Points one mmsghdr per response at its payload and destination, ready for a sender
+void prepare_send(ResponseEntry* responses, size_t count, iovec* iovecs, mmsghdr* msgs);
+
+// "ip:port"; also a node's identity on the hash ring
+std::string endpoint_name(const sockaddr_in& addr);
+// Parses "ip" or "ip:port", using default_port for the former; -1 if malformed
+int parse_endpoint(std::string_view endpoint, uint16_t default_port, sockaddr_in& addr);
+
+// Keys are steered by a hash of at most their first STEER_KEY_BYTES, small enough for a socket filter
+constexpr size_t STEER_KEY_BYTES = 32;
+// FNV-1a over those bytes; a key belongs to socket steer_hash(key) % sockets of the REUSEPORT group
+uint32_t steer_hash(std::string_view key);
+
+// Attaches a classic BPF program to fd's SO_REUSEPORT group of num_sockets sockets, indexed in bind
+// order. Binary GET/PUT/VGET/VPUT requests go to the socket owning their key and a one-byte datagram
+// to the socket it names (a wakeup); everything else keeps the kernel's flow hash. -1 if refused.
+int attach_key_steering(int fd, size_t num_sockets);
+
+enum class IoBackend
+{
+    SOCKETS,
+    IO_URING,
+};
+
+class SocketReceiver
+{
+    int fd;
+    // Preallocated ring of datagram buffers reused by every recvmmsg call
+    std::vector<std::array<char, DATAGRAM_SIZE>> buffers;
+    std::vector<sockaddr_in> sources;
+    std::vector<iovec> iovecs;
+    std::vector<mmsghdr> msgs;
+
+    int receive_batch();
+
+public:
+    SocketReceiver(int fd, size_t batch_size);
+
+    // Blocks (up to SO_RCVTIMEO) for the first datagram, then drains whatever else is queued.
+    // Datagrams cut short by the buffer are dropped, like in UringReceiver.
+    template <typename F>
+    int receive(F&& on_datagram)
+    {
+        const int received = receive_batch();
+        int delivered = 0;
+        for (int i = 0; i < received; ++i)
+        {
+            if ((msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0)
+            {
+                continue;
+            }
+            on_datagram(std::string_view(buffers[i].data(), msgs[i].msg_len), sources[i]);
+            ++delivered;
+        }
+        return received < 0 ? received : delivered;
+    }
+};
+
+class SocketSender
+{
+    int fd;
+    std::atomic<uint64_t>& syscall_count;
+
+public:
+    SocketSender(int fd, std::atomic<uint64_t>& syscall_count) : fd(fd), syscall_count(syscall_count) {}
+    size_t send(mmsghdr* msgs, size_t count);
+};
+
+// Multishot recvmsg into kernel-selected provided buffers; wakes on completions instead of polling
+class UringReceiver
+{
+    static constexpr unsigned short BUFFER_GROUP = 0;
+    static constexpr __u64 RECV_TAG = 1;
+    static constexpr __u64 PROVIDE_TAG = 2;
+    static constexpr long long WAIT_TIMEOUT_NS = 50'000'000;  // Bounds how long stop() takes to notice
+
+    IoUring ring;
+    int fd = -1;
+    msghdr msg{};
+    std::vector<char> buffers;
+    size_t buf_size = 0;
+    unsigned buf_count = 0;
+    bool armed = false;
+
+    int arm();
+    bool decode(unsigned short bid, int length, std::string_view& payload, sockaddr_in& source) const;
+    void recycle(unsigned short bid);
+
+public:
+    // Returns -1 when io_uring, provided buffers or multishot recvmsg are unavailable
+    int init(int fd, size_t batch_size);
+
+    template <typename F>
+    int receive(F&& on_datagram)
+    {
+        if (!armed && arm() != 0)
+        {
+            return -1;
+        }
+
+        ring.submit(1, WAIT_TIMEOUT_NS);
+
+        int delivered = 0;
+        ring.drain([&](const io_uring_cqe& cqe) {
+            if (cqe.user_data != RECV_TAG)
+            {
+                return;
+            }
+            if ((cqe.flags & IORING_CQE_F_MORE) == 0)
+            {
+                armed = false;
+            }
+            if ((cqe.flags & IORING_CQE_F_BUFFER) == 0)
+            {
+                return;
+            }
+
+            const auto bid = static_cast<unsigned short>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            std::string_view payload;
+            sockaddr_in source{};
+            if (cqe.res > 0 && decode(bid, cqe.res, payload, source))
+            {
+                on_datagram(payload, source);
+                ++delivered;
+            }
+            recycle(bid);
+        });
+
+        return delivered;
+    }
+};
+
+// Batched IORING_OP_SENDMSG submissions, one io_uring_enter per batch
+class UringSender
+{
+    IoUring ring;
+    int fd = -1;
+    std::atomic<uint64_t>* syscall_count = nullptr;
+    std::vector<size_t> pending;
+    std::vector<size_t> failed;
+
+public:
+    int init(int fd, size_t batch_size, std::atomic<uint64_t>& syscall_count);
+    size_t send(mmsghdr* msgs, size_t count);
+};
+
+#endif //DISTIBUTED_HASH_TABLE_NETIO_H
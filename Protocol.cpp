@@ -0,0 +1,231 @@
+#include "Protocol.h"
+
+namespace
+{
+template <typename T>
+T load_le(const char* data)
+{
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
+    {
+        value |= static_cast<T>(static_cast<uint8_t>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+template <typename T>
+void store_le(char* data, const T value)
+{
+    for (size_t i = 0; i < sizeof(T); ++i)
+    {
+        data[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+template <typename T>
+void append_le(std::string& out, const T value)
+{
+    char data[sizeof(T)];
+    store_le<T>(data, value);
+    out.append(data, sizeof(T));
+}
+
+// Consumes a T from the front of input; false if there are not enough bytes left
+template <typename T>
+bool take_le(std::string_view& input, T& value)
+{
+    if (input.size() < sizeof(T))
+    {
+        return false;
+    }
+    value = load_le<T>(input.data());
+    input.remove_prefix(sizeof(T));
+    return true;
+}
+
+bool take_bytes(std::string_view& input, const size_t length, std::string_view& bytes)
+{
+    if (input.size() < length)
+    {
+        return false;
+    }
+    bytes = input.substr(0, length);
+    input.remove_prefix(length);
+    return true;
+}
+}
+
+int protocol::decode(const std::string_view datagram, Message& message)
+{
+    if (datagram.size() < HEADER_SIZE || !is_binary(datagram))
+    {
+        return -1;
+    }
+
+    const char* data = datagram.data();
+    Header& header = message.header;
+    header.opcode = static_cast<Request>(static_cast<uint8_t>(data[1]));
+    header.flags = static_cast<uint8_t>(data[2]);
+    header.status = static_cast<Status>(static_cast<uint8_t>(data[3]));
+    header.key_len = load_le<uint16_t>(data + 4);
+    header.extras_len = load_le<uint16_t>(data + 6);
+    header.value_len = load_le<uint32_t>(data + 8);
+    header.request_id = load_le<uint64_t>(data + 12);
+
+    const size_t body = static_cast<size_t>(header.extras_len) + header.key_len + header.value_len;
+    if (datagram.size() != HEADER_SIZE + body)
+    {
+        return -1;
+    }
+
+    size_t offset = HEADER_SIZE;
+    message.extras = datagram.substr(offset, header.extras_len);
+    offset += header.extras_len;
+    message.key = datagram.substr(offset, header.key_len);
+    offset += header.key_len;
+    message.value = datagram.substr(offset, header.value_len);
+    return 0;
+}
+
+void protocol::encode(std::string& out, const Header& header, const std::string_view extras,
+                      const std::string_view key, const std::string_view value)
+{
+    out.resize(HEADER_SIZE);
+    char* data = out.data();
+    data[0] = static_cast<char>(MAGIC);
+    data[1] = static_cast<char>(header.opcode);
+    data[2] = static_cast<char>(header.flags);
+    data[3] = static_cast<char>(header.status);
+    store_le<uint16_t>(data + 4, static_cast<uint16_t>(key.size()));
+    store_le<uint16_t>(data + 6, static_cast<uint16_t>(extras.size()));
+    store_le<uint32_t>(data + 8, static_cast<uint32_t>(value.size()));
+    store_le<uint64_t>(data + 12, header.request_id);
+
+    out.append(extras);
+    out.append(key);
+    out.append(value);
+}
+
+void protocol::add_extras(std::string& datagram, const std::string_view extras)
+{
+    datagram.insert(HEADER_SIZE, extras);
+    store_le<uint16_t>(datagram.data() + 6, static_cast<uint16_t>(extras.size()));
+}
+
+void protocol::pack_key(std::string& out, const std::string_view key)
+{
+    append_le<uint16_t>(out, static_cast<uint16_t>(key.size()));
+    out.append(key);
+}
+
+void protocol::pack_pair(std::string& out, const std::string_view key, const std::string_view value)
+{
+    append_le<uint16_t>(out, static_cast<uint16_t>(key.size()));
+    append_le<uint32_t>(out, static_cast<uint32_t>(value.size()));
+    out.append(key);
+    out.append(value);
+}
+
+void protocol::pack_result(std::string& out, const Request opcode, const Status status, const std::string_view value)
+{
+    out.push_back(static_cast<char>(status));
+    if (opcode == MGET)
+    {
+        append_le<uint32_t>(out, static_cast<uint32_t>(value.size()));
+        out.append(value);
+    }
+}
+
+std::string protocol::pack_version(const uint64_t version)
+{
+    std::string out;
+    append_le<uint64_t>(out, version);
+    return out;
+}
+
+int protocol::unpack_version(const std::string_view extras, uint64_t& version)
+{
+    if (extras.size() != VERSION_SIZE)
+    {
+        return -1;
+    }
+    version = load_le<uint64_t>(extras.data());
+    return 0;
+}
+
+std::string protocol::pack_lease(const uint32_t term_us)
+{
+    std::string out;
+    append_le<uint32_t>(out, term_us);
+    return out;
+}
+
+int protocol::unpack_lease(const std::string_view extras, uint32_t& term_us)
+{
+    if (extras.size() != LEASE_SIZE)
+    {
+        return -1;
+    }
+    term_us = load_le<uint32_t>(extras.data());
+    return 0;
+}
+
+int protocol::unpack_keys(std::string_view packed, std::vector<std::string_view>& keys)
+{
+    keys.clear();
+    while (!packed.empty())
+    {
+        uint16_t key_len = 0;
+        std::string_view key;
+        if (!take_le(packed, key_len) || !take_bytes(packed, key_len, key))
+        {
+            return -1;
+        }
+        keys.push_back(key);
+    }
+    return 0;
+}
+
+int protocol::unpack_pairs(std::string_view packed, std::vector<std::pair<std::string_view, std::string_view>>& pairs)
+{
+    pairs.clear();
+    while (!packed.empty())
+    {
+        uint16_t key_len = 0;
+        uint32_t value_len = 0;
+        std::string_view key;
+        std::string_view value;
+        if (!take_le(packed, key_len) || !take_le(packed, value_len) ||
+            !take_bytes(packed, key_len, key) || !take_bytes(packed, value_len, value))
+        {
+            return -1;
+        }
+        pairs.emplace_back(key, value);
+    }
+    return 0;
+}
+
+int protocol::unpack_results(const Request opcode, std::string_view packed,
+                             std::vector<std::pair<Status, std::string_view>>& results)
+{
+    results.clear();
+    while (!packed.empty())
+    {
+        uint8_t status = 0;
+        std::string_view value;
+        if (!take_le(packed, status))
+        {
+            return -1;
+        }
+        if (opcode == MGET)
+        {
+            uint32_t value_len = 0;
+            if (!take_le(packed, value_len) || !take_bytes(packed, value_len, value))
+            {
+                return -1;
+            }
+        }
+        results.emplace_back(static_cast<Status>(status), value);
+    }
+    return 0;
+}
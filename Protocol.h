@@ -0,0 +1,145 @@
+#ifndef DISTIBUTED_HASH_TABLE_PROTOCOL_H
+#define DISTIBUTED_HASH_TABLE_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Request.h"
+
+enum class WireFormat
+{
+    TEXT,    // Legacy "GET:key" / "PUT:key:value"
+    BINARY,  // Fixed header + extras + key + value
+};
+
+// Binary framing, all integers little-endian:
+//
+//   0      magic (0xD5, never a printable character so it cannot start a text request)
+//   1      opcode (Request)
+//   2      flags
+//   3      status (responses only)
+//   4..5   key length
+//   6..7   extras length
+//   8..11  value length
+//   12..19 request id, echoed back unchanged in the response
+//
+// followed by extras, key and value bytes. Receivers skip extras they do not understand.
+//
+// MGET and MPUT leave the key empty and pack their entries into the value, in order:
+//
+//   MGET request   { u16 key length, key }*
+//   MPUT request   { u16 key length, u32 value length, key, value }*
+//   MGET response  { u8 status, u32 value length, value }*  one per requested key
+//   MPUT response  { u8 status }*
+//
+// VGET responses, VPUT requests and VPUT responses carry a u64 version as their extras. A VPUT reply
+// holds the version the replica ends up with, which is newer than the request's if it lost the race.
+//
+// STATS replies carry a text report as their value, one "name{labels} value" line per metric; the
+// STATS_PROMETHEUS request flag selects the Prometheus text exposition format instead.
+//
+// GET and VGET replies for a key the server sees as hot carry the HOT_KEY flag, hinting that the
+// client may cache the value rather than send every read to the same owner. A GET flagged LEASE
+// asks for a lease: a hot reply may then carry a u32 lease term in microseconds as its extras, and
+// the client may serve the value from its cache for that long after it sent the request. Servers
+// refuse leases on a key for one term after it is written, so often written keys are not cached.
+//
+// COPY requests pack their entries like MPUT and carry how long the copies stay valid as a lease
+// term in their extras. GET replies for a key copied this way, from its owner or from a copy, carry
+// the SPREAD flag: the client may send reads of it to any server while the flag keeps coming back.
+namespace protocol
+{
+constexpr uint8_t MAGIC = 0xD5;
+constexpr size_t HEADER_SIZE = 20;
+constexpr size_t MAX_REQUEST_SIZE = 1024;    // Server receive buffer size
+constexpr size_t MAX_RESPONSE_SIZE = 65507;  // Largest UDP payload over IPv4
+constexpr size_t VERSION_SIZE = sizeof(uint64_t);
+constexpr uint8_t STATS_PROMETHEUS = 0x01;  // STATS request flag
+constexpr uint8_t REPLICATE_FILL = 0x01;    // REPLICATE request flag: only add keys that are missing
+constexpr uint8_t HOT_KEY = 0x02;           // Response flag
+constexpr uint8_t LEASE = 0x04;             // GET request flag
+constexpr uint8_t SPREAD = 0x08;            // Response flag
+constexpr size_t LEASE_SIZE = sizeof(uint32_t);
+
+enum Status : uint8_t
+{
+    OK = 0,
+    NOT_FOUND = 1,
+    NOT_STORED = 2,
+    BAD_REQUEST = 3,
+    TRUNCATED = 4,  // MGET entry that did not fit in the reply; ask for it on its own
+    MOVED = 5,      // Key now lives elsewhere; single-key replies carry the new owner's "ip:port" as value
+};
+
+struct Header
+{
+    Request opcode{};
+    uint8_t flags = 0;
+    Status status = OK;
+    uint16_t key_len = 0;
+    uint16_t extras_len = 0;
+    uint32_t value_len = 0;
+    uint64_t request_id = 0;
+};
+
+// Decoded datagram; the views point into the receive buffer, nothing is copied
+struct Message
+{
+    Header header;
+    std::string_view extras;
+    std::string_view key;
+    std::string_view value;
+};
+
+inline bool is_binary(const std::string_view datagram)
+{
+    return !datagram.empty() && static_cast<uint8_t>(datagram.front()) == MAGIC;
+}
+
+int decode(std::string_view datagram, Message& message);
+
+// Sets flags in the header of an already encoded message
+inline void add_flags(std::string& datagram, const uint8_t flags)
+{
+    datagram[2] = static_cast<char>(static_cast<uint8_t>(datagram[2]) | flags);
+}
+
+// Inserts extras into an already encoded message that has none
+void add_extras(std::string& datagram, std::string_view extras);
+
+// Replaces the contents of out with the encoded message; reuses its capacity
+void encode(std::string& out, const Header& header, std::string_view extras,
+            std::string_view key, std::string_view value);
+
+// Multi-key packing; the unpack functions return -1 if the payload is not a whole number of entries
+void pack_key(std::string& out, std::string_view key);
+void pack_pair(std::string& out, std::string_view key, std::string_view value);
+void pack_result(std::string& out, Request opcode, Status status, std::string_view value);
+int unpack_keys(std::string_view packed, std::vector<std::string_view>& keys);
+int unpack_pairs(std::string_view packed, std::vector<std::pair<std::string_view, std::string_view>>& pairs);
+int unpack_results(Request opcode, std::string_view packed, std::vector<std::pair<Status, std::string_view>>& results);
+
+// Versions travel in the extras of VGET/VPUT; unpack returns -1 unless extras is exactly one version
+std::string pack_version(uint64_t version);
+int unpack_version(std::string_view extras, uint64_t& version);
+
+// Lease terms travel in the extras of GET replies; unpack returns -1 unless extras is exactly one term
+std::string pack_lease(uint32_t term_us);
+int unpack_lease(std::string_view extras, uint32_t& term_us);
+
+inline size_t packed_key_size(const std::string_view key) { return sizeof(uint16_t) + key.size(); }
+inline size_t packed_pair_size(const std::string_view key, const std::string_view value)
+{
+    return sizeof(uint16_t) + sizeof(uint32_t) + key.size() + value.size();
+}
+inline size_t packed_result_size(const Request opcode, const std::string_view value)
+{
+    return opcode == MGET ? sizeof(uint8_t) + sizeof(uint32_t) + value.size() : sizeof(uint8_t);
+}
+}
+
+#endif //DISTIBUTED_HASH_TABLE_PROTOCOL_H
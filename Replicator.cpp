@@ -0,0 +1,327 @@
+#include "Replicator.h"
+
+#include <array>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+Replicator::Replicator(std::vector<sockaddr_in> replicas, const Durability durability, const uint8_t flags)
+    : replicas(std::move(replicas)), durability(durability), flags(flags)
+{
+}
+
+Replicator::~Replicator()
+{
+    stop();
+    join();
+    if (socket_fd != -1)
+    {
+        close(socket_fd);
+    }
+}
+
+int Replicator::start(const int reply_fd)
+{
+    socket_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (socket_fd == -1)
+    {
+        return -1;
+    }
+
+    this->reply_fd = reply_fd;
+    running.store(true, std::memory_order_relaxed);
+    worker = std::thread(&Replicator::run, this);
+    return 0;
+}
+
+void Replicator::stop()
+{
+    running.store(false, std::memory_order_relaxed);
+    waiter.notify_all();
+}
+
+void Replicator::join()
+{
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+}
+
+void Replicator::replicate(std::vector<LogEntry>&& writes, std::optional<ResponseEntry> reply)
+{
+    outstanding_writes.fetch_add(writes.size(), std::memory_order_relaxed);
+    queue.enqueue(Shipment{std::move(writes), std::move(reply)});
+    waiter.notify();
+}
+
+void Replicator::seal(std::string& payload, size_t& writes, std::vector<ResponseEntry>& replies,
+                      std::vector<uint64_t>& sealed)
+{
+    const uint64_t sequence = next_sequence++;
+
+    protocol::Header header;
+    header.opcode = REPLICATE;
+    header.flags = flags;
+    header.request_id = sequence;
+
+    Batch batch;
+    protocol::encode(batch.datagram, header, {}, {}, payload);
+    batch.acked.assign(replicas.size(), false);
+    batch.pending = replicas.size();
+    batch.replies = std::move(replies);
+    batch.writes = writes;
+
+    unacked.emplace(sequence, std::move(batch));
+    sealed.push_back(sequence);
+    shipped_batches.fetch_add(1, std::memory_order_relaxed);
+
+    payload.clear();
+    writes = 0;
+    replies.clear();
+}
+
+void Replicator::transmit(const std::vector<uint64_t>& sequences)
+{
+    std::vector<iovec> iovecs;
+    std::vector<mmsghdr> msgs;
+    iovecs.reserve(sequences.size() * replicas.size());
+    msgs.reserve(sequences.size() * replicas.size());
+
+    const auto now = Clock::now();
+    for (const uint64_t sequence : sequences)
+    {
+        Batch& batch = unacked.at(sequence);
+        if (batch.first_sent == Clock::time_point{})
+        {
+            batch.first_sent = now;
+        }
+        batch.last_sent = now;
+
+        for (size_t r = 0; r < replicas.size(); ++r)
+        {
+            if (batch.acked[r])
+            {
+                continue;
+            }
+            iovecs.push_back(iovec{batch.datagram.data(), batch.datagram.size()});
+            msgs.emplace_back();
+            msgs.back().msg_hdr.msg_name = &replicas[r];
+            msgs.back().msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+    }
+
+    // Pointers into iovecs are only taken once it has stopped growing
+    for (size_t i = 0; i < msgs.size(); ++i)
+    {
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // Anything the kernel refuses is picked up by the retransmit timer
+    size_t sent = 0;
+    while (sent < msgs.size())
+    {
+        const int result = sendmmsg(socket_fd, msgs.data() + sent, static_cast<unsigned int>(msgs.size() - sent), 0);
+        if (result <= 0)
+        {
+            break;
+        }
+        sent += static_cast<size_t>(result);
+    }
+}
+
+void Replicator::release(Batch& batch)
+{
+    if (batch.replies.empty())
+    {
+        return;
+    }
+
+    std::vector<iovec> iovecs(batch.replies.size());
+    std::vector<mmsghdr> msgs(batch.replies.size());
+    prepare_send(batch.replies.data(), batch.replies.size(), iovecs.data(), msgs.data());
+    SocketSender sender(reply_fd, reply_syscalls);
+    sender.send(msgs.data(), msgs.size());
+}
+
+void Replicator::drain_acks()
+{
+    constexpr size_t ACK_BATCH = 32;
+    constexpr size_t ACK_SIZE = 64;  // Acks are a bare header
+    std::array<std::array<char, ACK_SIZE>, ACK_BATCH> buffers;
+    std::array<sockaddr_in, ACK_BATCH> sources{};
+    std::array<iovec, ACK_BATCH> iovecs{};
+    std::array<mmsghdr, ACK_BATCH> msgs{};
+
+    while (true)
+    {
+        for (size_t i = 0; i < ACK_BATCH; ++i)
+        {
+            iovecs[i] = iovec{buffers[i].data(), buffers[i].size()};
+            msgs[i].msg_hdr = msghdr{};
+            msgs[i].msg_hdr.msg_name = &sources[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            msgs[i].msg_hdr.msg_iov = &iovecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        const int received = recvmmsg(socket_fd, msgs.data(), ACK_BATCH, MSG_DONTWAIT, nullptr);
+        if (received <= 0)
+        {
+            return;
+        }
+
+        for (int i = 0; i < received; ++i)
+        {
+            protocol::Message message;
+            if (protocol::decode(std::string_view(buffers[i].data(), msgs[i].msg_len), message) == -1 ||
+                message.header.opcode != REPLICATE)
+            {
+                continue;
+            }
+
+            // Acks for batches already released or given up on are simply late
+            const auto it = unacked.find(message.header.request_id);
+            if (it == unacked.end())
+            {
+                continue;
+            }
+
+            Batch& batch = it->second;
+            for (size_t r = 0; r < replicas.size(); ++r)
+            {
+                if (!batch.acked[r] && replicas[r].sin_addr.s_addr == sources[i].sin_addr.s_addr &&
+                    replicas[r].sin_port == sources[i].sin_port)
+                {
+                    batch.acked[r] = true;
+                    --batch.pending;
+                }
+            }
+
+            if (batch.pending == 0)
+            {
+                release(batch);
+                outstanding_writes.fetch_sub(batch.writes, std::memory_order_relaxed);
+                unacked.erase(it);
+            }
+        }
+
+        if (static_cast<size_t>(received) < ACK_BATCH)
+        {
+            return;
+        }
+    }
+}
+
+void Replicator::expire(const Clock::time_point now)
+{
+    std::vector<uint64_t> resend;
+    std::vector<uint64_t> abandoned;
+
+    for (const auto& [sequence, batch] : unacked)
+    {
+        if (now - batch.first_sent >= GIVE_UP_AFTER)
+        {
+            abandoned.push_back(sequence);
+        }
+        else if (now - batch.last_sent >= RETRANSMIT_INTERVAL)
+        {
+            resend.push_back(sequence);
+        }
+    }
+
+    // A replica that stays silent this long is treated as down; SYNC replies for the batch are
+    // dropped so clients see a timeout instead of an acknowledgement that was never earned
+    for (const uint64_t sequence : abandoned)
+    {
+        outstanding_writes.fetch_sub(unacked.at(sequence).writes, std::memory_order_relaxed);
+        unacked.erase(sequence);
+        failed_batches.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (!resend.empty())
+    {
+        transmit(resend);
+    }
+}
+
+bool Replicator::wait_for_acks() const
+{
+    const timespec timeout{0, std::chrono::duration_cast<std::chrono::nanoseconds>(ACK_POLL).count()};
+    pollfd pfd{socket_fd, POLLIN, 0};
+    return ppoll(&pfd, 1, &timeout, nullptr) > 0;
+}
+
+void Replicator::run()
+{
+    Shipment shipments[BULK_SIZE];
+    std::string payload;
+    size_t payload_writes = 0;
+    std::vector<ResponseEntry> replies;
+    std::vector<uint64_t> sealed;
+    unsigned idle_rounds = 0;
+
+    while (running.load(std::memory_order_relaxed))
+    {
+        // Everything queued since the last round goes out together
+        const size_t count = queue.try_dequeue_bulk(shipments, BULK_SIZE);
+        for (size_t i = 0; i < count; ++i)
+        {
+            Shipment& shipment = shipments[i];
+
+            // A shipment never straddles batches, so its reply is released by exactly one ack round
+            size_t size = 0;
+            for (const LogEntry& write : shipment.writes)
+            {
+                size += protocol::packed_pair_size(write.key, write.value);
+            }
+            if (!payload.empty() && protocol::HEADER_SIZE + payload.size() + size > protocol::MAX_REQUEST_SIZE)
+            {
+                seal(payload, payload_writes, replies, sealed);
+            }
+
+            for (const LogEntry& write : shipment.writes)
+            {
+                protocol::pack_pair(payload, write.key, write.value);
+            }
+            payload_writes += shipment.writes.size();
+            shipped_writes.fetch_add(shipment.writes.size(), std::memory_order_relaxed);
+            if (shipment.reply.has_value())
+            {
+                replies.push_back(std::move(shipment.reply.value()));
+            }
+
+            shipment.writes.clear();
+            shipment.reply.reset();
+        }
+
+        if (!payload.empty())
+        {
+            seal(payload, payload_writes, replies, sealed);
+        }
+        if (!sealed.empty())
+        {
+            transmit(sealed);
+            sealed.clear();
+        }
+
+        drain_acks();
+        expire(Clock::now());
+
+        if (count > 0)
+        {
+            idle_rounds = 0;
+            continue;
+        }
+
+        if (unacked.empty())
+        {
+            waiter.wait(idle_rounds, [this] { return queue.size_approx() > 0; });
+        }
+        else
+        {
+            wait_for_acks();
+        }
+    }
+}
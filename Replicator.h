@@ -0,0 +1,107 @@
+#ifndef DISTIBUTED_HASH_TABLE_REPLICATOR_H
+#define DISTIBUTED_HASH_TABLE_REPLICATOR_H
+
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+
+#include "IdleWaiter.h"
+#include "NetIo.h"
+#include "ds/concurrentqueue.h"
+#include "ds/HashMap/phmap.hpp"
+
+enum class Durability
+{
+    ASYNC,  // Reply once the write is applied locally; replicas catch up in the background
+    SYNC,   // Hold the reply until every replica has acknowledged the write
+};
+
+struct LogEntry
+{
+    std::string key;
+    std::string value;
+    uint64_t version = 0;  // Quorum (VPUT) writes only; such keys are placed by clients, never migrated
+};
+
+// Ships a primary's successful writes to its backups. Writes from all executor threads are
+// grouped into REPLICATE datagrams (one per round of the replication thread, so batches grow
+// with load), sent to every replica, and retransmitted until each replica acknowledges them.
+class Replicator
+{
+    using Clock = std::chrono::steady_clock;
+    static constexpr size_t BULK_SIZE = 64;
+    static constexpr std::chrono::milliseconds RETRANSMIT_INTERVAL{20};
+    static constexpr std::chrono::milliseconds GIVE_UP_AFTER{1000};
+    static constexpr std::chrono::microseconds ACK_POLL{100};  // Wait for acks while writes are outstanding
+
+    struct Shipment
+    {
+        std::vector<LogEntry> writes;
+        std::optional<ResponseEntry> reply;  // SYNC only
+    };
+
+    struct Batch
+    {
+        std::string datagram;
+        std::vector<bool> acked;  // Per replica
+        size_t pending = 0;       // Replicas yet to ack
+        std::vector<ResponseEntry> replies;
+        size_t writes = 0;
+        Clock::time_point first_sent;
+        Clock::time_point last_sent;
+    };
+
+    std::vector<sockaddr_in> replicas;
+    Durability durability;
+    uint8_t flags;       // Header flags of every REPLICATE sent
+    int socket_fd = -1;  // Ephemeral port; replicas ack to it
+    int reply_fd = -1;   // A server socket, so held replies come from the port clients sent to
+    uint64_t next_sequence = 1;
+
+    moodycamel::ConcurrentQueue<Shipment> queue;
+    IdleWaiter waiter{WaitPolicy::BLOCKING};
+    gtl::flat_hash_map<uint64_t, Batch> unacked;
+    std::thread worker;
+    std::atomic<bool> running{false};
+
+    std::atomic<uint64_t> shipped_batches{0};
+    std::atomic<uint64_t> shipped_writes{0};
+    std::atomic<uint64_t> failed_batches{0};
+    std::atomic<uint64_t> reply_syscalls{0};
+    std::atomic<uint64_t> outstanding_writes{0};  // Queued or unacked
+
+    void run();
+    void seal(std::string& payload, size_t& writes, std::vector<ResponseEntry>& replies, std::vector<uint64_t>& sealed);
+    void transmit(const std::vector<uint64_t>& sequences);
+    void drain_acks();
+    void expire(Clock::time_point now);
+    void release(Batch& batch);
+    bool wait_for_acks() const;
+
+public:
+    Replicator(std::vector<sockaddr_in> replicas, Durability durability, uint8_t flags = 0);
+    ~Replicator();
+    Replicator(const Replicator&) = delete;
+    Replicator& operator=(const Replicator&) = delete;
+
+    int start(int reply_fd);
+    // Only flips a flag and wakes the thread, so it is safe from a signal handler
+    void stop();
+    void join();
+
+    bool holds_replies() const { return durability == Durability::SYNC; }
+    // Called by executors after a successful local apply; reply is only passed with SYNC durability
+    void replicate(std::vector<LogEntry>&& writes, std::optional<ResponseEntry> reply);
+
+    uint64_t get_shipped_batches() const { return shipped_batches.load(); }
+    uint64_t get_shipped_writes() const { return shipped_writes.load(); }
+    uint64_t get_failed_batches() const { return failed_batches.load(); }
+    // Zero once everything handed to replicate() has been acked or given up on
+    uint64_t get_outstanding_writes() const { return outstanding_writes.load(); }
+};
+
+#endif //DISTIBUTED_HASH_TABLE_REPLICATOR_H
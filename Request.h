@@ -1,10 +1,21 @@
 #ifndef DISTIBUTED_HASH_TABLE_REQUEST_H
 #define DISTIBUTED_HASH_TABLE_REQUEST_H
 
+// Values double as binary protocol opcodes, so they must stay stable
 enum Request
 {
-    GET,
-    PUT,
+    GET = 0,
+    PUT = 1,
+    MGET = 2,  // Many keys packed into one datagram, see protocol::pack_key
+    MPUT = 3,
+    REPLICATE = 4,  // Primary -> backup write batch, packed like MPUT; acked by request id
+    VGET = 5,       // GET that also returns the stored version, for quorum reads
+    VPUT = 6,       // Versioned overwrite: applied only if newer than what is stored
+    MIGRATE = 7,    // Admin: rebalance onto the layout in the value, see Storage::start_migration
+    GOSSIP = 8,     // Server <-> server membership probes, see Gossip
+    MEMBERS = 9,    // Live members and their version, for clients refreshing their ring
+    STATS = 10,     // Text report of counters, queue depths, table occupancy and stage latencies
+    COPY = 11,      // Owner -> peers read-only copies of its hottest keys, packed like MPUT; not acked
 };
 
 #endif //DISTIBUTED_HASH_TABLE_REQUEST_H
\ No newline at end of file
@@ -1,84 +1,1378 @@
 #include "Storage.h"
 
-#include <chrono>
+#include <algorithm>
+#include <charconv>
+#include <iterator>
+#include <numeric>
+#include <pthread.h>
 #include <ranges>
 #include <sys/socket.h>
 #include <thread>
 #include <unistd.h>
+#include <vector>
 
-Storage::Storage(const uint16_t port) : port(port) {}
+Storage::Storage(const uint16_t port) : Storage(StorageConfig{.port = port}) {}
+
+Storage::Storage(const StorageConfig& config)
+    : config(config), task_waiter(config.wait_policy), response_waiter(config.wait_policy)
+{
+    if (this->config.recv_batch_size == 0)
+    {
+        this->config.recv_batch_size = 1;
+    }
+    if (this->config.num_receivers == 0)
+    {
+        this->config.num_receivers = 1;
+    }
+    if (this->config.num_executors == 0)
+    {
+        this->config.num_executors = 1;
+    }
+    if (this->config.num_shards == 0)
+    {
+        this->config.num_shards = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
 
 Storage::~Storage()
 {
-    stop();
+    stop();
+}
+
+int Storage::create_server(int& server_fd, const bool reuse_port) const
+{
+    server_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (server_fd == -1)
+    {
+        return -1;
+    }
+
+    if (reuse_port)
+    {
+        constexpr int enable = 1;
+        if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == -1)
+        {
+            close(server_fd);
+            return -1;
+        }
+    }
+
+    timeval tv{};
+    tv.tv_sec = 0;
+    tv.tv_usec = 50000;  // 50ms
+    setsockopt(server_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(config.port);
+
+    if (bind(server_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1)
+    {
+        close(server_fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+namespace
+{
+constexpr size_t NO_SHARD = SIZE_MAX;
+thread_local size_t current_shard = NO_SHARD;  // The shard this thread serves, if any
+
+void pin_to_core(const size_t core)
+{
+    const unsigned int cores = std::thread::hardware_concurrency();
+    if (cores == 0)
+    {
+        return;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core % cores, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+}
+
+Storage::StageHistograms& Storage::register_latencies()
+{
+    std::lock_guard lock(latency_mutex);
+    latencies.push_back(std::make_unique<StageHistograms>());
+    return *latencies.back();
+}
+
+template <typename F>
+bool Storage::on_shards(const std::span<const size_t> targets, F&& f)
+{
+    // Counted before checking running, so a stopping shard either sees this waiter or it sees the flag
+    shard_waiters.fetch_add(1);
+    if (!running.load())
+    {
+        shard_waiters.fetch_sub(1);
+        return false;
+    }
+
+    std::atomic<size_t> pending{0};
+    bool local = false;
+    for (const size_t target : targets)
+    {
+        if (target == current_shard)
+        {
+            local = true;
+            continue;
+        }
+        pending.fetch_add(1, std::memory_order_relaxed);
+        shards[target]->jobs.enqueue([this, &f, &pending, target] {
+            f(shards[target]->table, target);
+            pending.fetch_sub(1, std::memory_order_release);
+        });
+        wake_shard(target);
+    }
+    if (local)
+    {
+        f(shards[current_shard]->table, current_shard);
+    }
+
+    // A shard keeps serving its own jobs meanwhile, so two shards waiting on each other both finish
+    while (pending.load(std::memory_order_acquire) > 0)
+    {
+        if (current_shard != NO_SHARD)
+        {
+            run_shard_jobs(*shards[current_shard]);
+        }
+        std::this_thread::yield();
+    }
+    shard_waiters.fetch_sub(1);
+    return true;
+}
+
+template <typename F>
+bool Storage::with_key_table(const std::string_view key, F&& f)
+{
+    if (shards.empty())
+    {
+        f(table);
+        return true;
+    }
+    const size_t owner = shard_of(key);
+    if (owner == current_shard)
+    {
+        f(shards[owner]->table);
+        return true;
+    }
+    return on_shards(std::span(&owner, 1), [&f](ShardTable& target, size_t) { f(target); });
+}
+
+template <typename F>
+bool Storage::with_tables(F&& f)
+{
+    if (shards.empty())
+    {
+        f(table, 0);
+        return true;
+    }
+    std::vector<size_t> all(shards.size());
+    std::iota(all.begin(), all.end(), 0);
+    return on_shards(all, f);
+}
+
+void Storage::run_shard_jobs(Shard& shard)
+{
+    std::function<void()> job;
+    while (shard.jobs.try_dequeue(job))
+    {
+        job();
+    }
+}
+
+void Storage::wake_shard(const size_t shard) const
+{
+    // Steered to the shard's own socket, where it interrupts the receive wait and is then dropped as malformed
+    sockaddr_in self{};
+    self.sin_family = AF_INET;
+    self.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    self.sin_port = htons(config.port);
+    const auto index = static_cast<char>(shard);
+    sendto(shards[shard]->fd, &index, 1, 0, reinterpret_cast<const sockaddr*>(&self), sizeof(self));
+}
+
+Storage::HotKeyView Storage::register_hot_keys()
+{
+    std::lock_guard lock(hot_key_mutex);
+    hot_key_samplers.push_back(std::make_unique<HotKeySampler>());
+    return HotKeyView{.sampler = hot_key_samplers.back().get()};
+}
+
+std::shared_ptr<const HotKeySet> Storage::get_hot_keys() const
+{
+    std::lock_guard lock(hot_key_mutex);
+    return hot_keys;
+}
+
+void Storage::track_key(HotKeyView& view, const TaskEntry& task, const std::vector<LogEntry>& writes,
+                        const uint64_t now_ns, std::string& response)
+{
+    if (hot_key_epoch.load(std::memory_order_acquire) != view.epoch)
+    {
+        std::lock_guard lock(hot_key_mutex);
+        view.set = hot_keys;
+        view.epoch = hot_key_epoch.load(std::memory_order_relaxed);
+    }
+    if (copy_epoch.load(std::memory_order_acquire) != view.copies_epoch)
+    {
+        std::lock_guard lock(copy_mutex);
+        view.copies = hot_copies;
+        view.copies_epoch = copy_epoch.load(std::memory_order_relaxed);
+    }
+
+    // Every applied write is stamped, whatever carried it, so no lease outlives a write by more than a
+    // term; writes to a copied key are queued for the copies straight away rather than left to the next refresh
+    const bool spreading = view.set && !view.set->spread.empty();
+    if (config.lease_ms > 0 || spreading)
+    {
+        for (const LogEntry& write : writes)
+        {
+            const uint64_t hash = HashRing::hash(write.key);
+            write_stamps[hash % LEASE_SLOTS].store(now_ns, std::memory_order_relaxed);
+            if (spreading && view.set->is_spread(hash))
+            {
+                copy_writes.enqueue({write.key, write.value});
+            }
+        }
+    }
+
+    // Multi-key requests are left out: their keys are spread over the batch and cost one reply
+    if (task.req != GET && task.req != PUT && task.req != VGET && task.req != VPUT)
+    {
+        return;
+    }
+
+    // A key this server does not hold may be another server's hot key it has a copy of
+    bool copied = false;
+    if (task.req == GET && task.format == WireFormat::BINARY && view.copies && response.size() >= protocol::HEADER_SIZE &&
+        static_cast<uint8_t>(response[3]) == protocol::NOT_FOUND)
+    {
+        const auto found = view.copies->find(task.key);
+        if (found != view.copies->end() && found->second.expires_ns > now_ns)
+        {
+            response = format_response(task, protocol::OK, found->second.value);
+            protocol::add_flags(response, protocol::HOT_KEY | protocol::SPREAD);
+            copy_reads.fetch_add(1, std::memory_order_relaxed);
+            copied = true;
+        }
+    }
+
+    const bool sampled = view.sampler->should_sample();
+    const bool hinting = !copied && view.set && !view.set->hashes.empty() && task.format == WireFormat::BINARY &&
+                         (task.req == GET || task.req == VGET);
+    if (!sampled && !hinting)
+    {
+        return;
+    }
+
+    const uint64_t hash = HashRing::hash(task.key);
+    if (sampled)
+    {
+        view.sampler->observe(task.key, hash);
+    }
+    if (hinting && response.size() >= protocol::HEADER_SIZE && static_cast<uint8_t>(response[3]) == protocol::OK &&
+        view.set->contains(hash))
+    {
+        protocol::add_flags(response, view.set->is_spread(hash) ? protocol::HOT_KEY | protocol::SPREAD : protocol::HOT_KEY);
+        hot_key_hints.fetch_add(1, std::memory_order_relaxed);
+        if (task.req != GET || (task.flags & protocol::LEASE) == 0 || config.lease_ms == 0)
+        {
+            return;
+        }
+
+        const uint64_t term_ns = uint64_t{config.lease_ms} * 1'000'000;
+        // Another thread's stamp may be slightly ahead of now_ns; that still counts as recent
+        if (write_stamps[hash % LEASE_SLOTS].load(std::memory_order_relaxed) + term_ns > now_ns)
+        {
+            leases_refused.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        protocol::add_extras(response, protocol::pack_lease(config.lease_ms * 1000));
+        leases_granted.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Storage::maintain_hot_keys()
+{
+    // Copies of written keys go out within a poll; the set is rebuilt once per interval
+    constexpr std::chrono::milliseconds POLL{1};
+    constexpr size_t WRITE_BATCH = 64;
+    uint64_t next_refresh = LatencyHistogram::now_ns() + HOT_KEY_INTERVAL_NS;
+    std::shared_ptr<const HotKeySet> set;
+    std::vector<std::pair<std::string, std::string>> writes(WRITE_BATCH);
+
+    while (running.load(std::memory_order_relaxed))
+    {
+        const uint64_t now_ns = LatencyHistogram::now_ns();
+        if (now_ns >= next_refresh)
+        {
+            refresh_hot_keys();
+            next_refresh = now_ns + HOT_KEY_INTERVAL_NS;
+        }
+
+        const size_t count = copy_writes.try_dequeue_bulk(writes.begin(), WRITE_BATCH);
+        if (count == 0)
+        {
+            std::this_thread::sleep_for(POLL);
+            continue;
+        }
+        {
+            std::lock_guard lock(hot_key_mutex);
+            set = hot_keys;
+        }
+        // Only spread keys are queued, so a set exists; its peers may have changed since, which is fine
+        if (set)
+        {
+            push_copies(set->peers, {writes.begin(), writes.begin() + static_cast<std::ptrdiff_t>(count)});
+        }
+    }
+}
+
+void Storage::refresh_hot_keys()
+{
+    std::vector<std::pair<std::string, uint64_t>> candidates;
+    uint64_t sampled = 0;
+    std::shared_ptr<const HotKeySet> previous;
+    {
+        std::lock_guard lock(hot_key_mutex);
+        for (const auto& sampler : hot_key_samplers)
+        {
+            sampled += sampler->harvest(candidates);
+        }
+        previous = hot_keys;
+    }
+
+    // A key served by several threads is a candidate in each; their sketches saw disjoint requests,
+    // so the estimates add up
+    std::ranges::sort(candidates);
+    std::vector<std::pair<std::string, uint64_t>> merged;
+    for (auto& [key, estimate] : candidates)
+    {
+        if (!merged.empty() && merged.back().first == key)
+        {
+            merged.back().second += estimate;
+        }
+        else
+        {
+            merged.emplace_back(std::move(key), estimate);
+        }
+    }
+    const size_t top = std::min(merged.size(), HOT_KEY_TOP);
+    std::ranges::partial_sort(merged, merged.begin() + static_cast<std::ptrdiff_t>(top), std::ranges::greater{},
+                              &std::pair<std::string, uint64_t>::second);
+    merged.resize(top);
+
+    auto set = std::make_shared<HotKeySet>();
+    if (gossip && config.spread_rate > 0)
+    {
+        std::vector<std::string> names;
+        gossip->snapshot(names);
+        for (const std::string& name : names)
+        {
+            sockaddr_in addr{};
+            if (name != self_name && parse_endpoint(name, 0, addr) == 0)
+            {
+                set->peers.push_back(addr);
+            }
+        }
+    }
+
+    // Counts are halved every interval, so a steady rate r has accumulated to 2r by now
+    const auto per_second = [](const uint64_t count) {
+        return (count << HotKeySampler::SAMPLE_SHIFT) / 2 * 1'000'000'000 / HOT_KEY_INTERVAL_NS;
+    };
+    set->sampled = per_second(sampled);
+    std::vector<std::pair<std::string, std::string>> copies;
+    for (auto& [key, estimate] : merged)
+    {
+        const uint64_t rate = per_second(estimate);
+        const uint64_t hash = HashRing::hash(key);
+        if (sampled >= HOT_KEY_MIN_SAMPLES && estimate * HOT_KEY_SHARE >= sampled)
+        {
+            set->hashes.push_back(hash);
+
+            // Once copied, the owner only sees its share of the reads, so the key stays copied until
+            // that share drops below the threshold split over every server
+            const uint64_t threshold = previous && previous->is_spread(hash)
+                                           ? config.spread_rate / (set->peers.size() + 1) : config.spread_rate;
+            if (!set->peers.empty() && config.spread_rate > 0 && rate >= threshold)
+            {
+                with_key_table(key, [&copies, &key](auto& target) {
+                    target.if_contains(key, [&copies, &key](const auto& item) { copies.emplace_back(key, item.second.value); });
+                });
+                if (!copies.empty() && copies.back().first == key)
+                {
+                    set->spread.push_back(hash);
+                }
+            }
+        }
+        set->top.emplace_back(std::move(key), rate);
+    }
+    std::ranges::sort(set->hashes);
+    std::ranges::sort(set->spread);
+
+    // Pushed before the flag goes out, so the first readers sent elsewhere find the copies there
+    if (!copies.empty())
+    {
+        push_copies(set->peers, copies);
+    }
+
+    std::lock_guard lock(hot_key_mutex);
+    hot_keys = std::move(set);
+    hot_key_epoch.fetch_add(1, std::memory_order_release);
+}
+
+void Storage::push_copies(const std::vector<sockaddr_in>& peers,
+                          const std::vector<std::pair<std::string, std::string>>& entries)
+{
+    // As many entries per datagram as a receive buffer holds; an entry too large for one is not copied
+    protocol::Header header;
+    header.opcode = COPY;
+    const std::string lifetime = protocol::pack_lease(static_cast<uint32_t>(COPY_LIFETIME_NS / 1000));
+    const size_t limit = protocol::MAX_REQUEST_SIZE - protocol::HEADER_SIZE - lifetime.size();
+
+    std::string packed;
+    std::string datagram;
+    size_t count = 0;
+    const auto flush = [&] {
+        if (count == 0)
+        {
+            return;
+        }
+        protocol::encode(datagram, header, lifetime, {}, packed);
+        for (const sockaddr_in& peer : peers)
+        {
+            sendto(server_fds.front(), datagram.data(), datagram.size(), 0, reinterpret_cast<const sockaddr*>(&peer),
+                   sizeof(peer));
+        }
+        copies_pushed.fetch_add(count * peers.size(), std::memory_order_relaxed);
+        packed.clear();
+        count = 0;
+    };
+
+    for (const auto& [key, value] : entries)
+    {
+        const size_t size = protocol::packed_pair_size(key, value);
+        if (size > limit)
+        {
+            continue;
+        }
+        if (packed.size() + size > limit)
+        {
+            flush();
+        }
+        protocol::pack_pair(packed, key, value);
+        ++count;
+    }
+    flush();
+}
+
+std::string Storage::apply_copies(const TaskEntry& task)
+{
+    std::vector<std::pair<std::string_view, std::string_view>> entries;
+    if (!task.value.has_value() || protocol::unpack_pairs(task.value.value(), entries) == -1)
+    {
+        return {};
+    }
+
+    // Copy-on-write: readers keep the snapshot they loaded, and expired copies are dropped here
+    const uint64_t now_ns = LatencyHistogram::now_ns();
+    std::lock_guard lock(copy_mutex);
+    auto copies = std::make_shared<HotKeyCopies>();
+    if (hot_copies)
+    {
+        for (const auto& [key, copy] : *hot_copies)
+        {
+            if (copy.expires_ns > now_ns)
+            {
+                copies->emplace(key, copy);
+            }
+        }
+    }
+    for (const auto& [key, value] : entries)
+    {
+        (*copies)[std::string(key)] = HotKeyCopy{std::string(value), now_ns + task.version * 1000};
+    }
+    hot_copies = std::move(copies);
+    copy_epoch.fetch_add(1, std::memory_order_release);
+    return {};
+}
+
+LatencyHistogram::Summary Storage::get_stage_latency(const Stage stage) const
+{
+    LatencyHistogram::Counts totals{};
+    {
+        std::lock_guard lock(latency_mutex);
+        for (const auto& histograms : latencies)
+        {
+            (*histograms)[static_cast<size_t>(stage)].merge_into(totals);
+        }
+    }
+    return LatencyHistogram::summarize(totals);
+}
+
+template <typename Receiver>
+void Storage::receive_from(Receiver& receiver)
+{
+    std::vector<TaskEntry> tasks(config.recv_batch_size);
+    StageHistograms& latency = register_latencies();
+
+    while (running.load(std::memory_order_relaxed))
+    {
+        size_t parsed = 0;
+        const int received = receiver.receive([&](const std::string_view payload, const sockaddr_in& source) {
+            if (parsed == tasks.size())
+            {
+                tasks.emplace_back();
+            }
+
+            const uint64_t arrived = LatencyHistogram::now_ns();
+            TaskEntry& task = tasks[parsed];
+            if (parse_req(payload, task) == -1)
+            {
+                return;
+            }
+
+            task.client_addr = source;
+            task.stage_start_ns = arrived;
+            ++parsed;
+        });
+
+        if (received <= 0 || parsed == 0)
+        {
+            continue;
+        }
+
+        const uint64_t queued = LatencyHistogram::now_ns();
+        for (size_t i = 0; i < parsed; ++i)
+        {
+            latency[static_cast<size_t>(Stage::RECEIVE)].record(queued - tasks[i].stage_start_ns);
+            tasks[i].stage_start_ns = queued;
+        }
+
+        task_queue.enqueue_bulk(std::make_move_iterator(tasks.begin()), parsed);
+        task_waiter.notify();
+        received_count.fetch_add(parsed, std::memory_order_relaxed);
+    }
+}
+
+void Storage::receive(const int server_fd)
+{
+    if (config.io_backend == IoBackend::IO_URING)
+    {
+        UringReceiver receiver;
+        if (receiver.init(server_fd, config.recv_batch_size) == 0)
+        {
+            receive_from(receiver);
+            return;
+        }
+        active_backend.store(IoBackend::SOCKETS, std::memory_order_relaxed);
+    }
+
+    SocketReceiver receiver(server_fd, config.recv_batch_size);
+    receive_from(receiver);
+}
+
+std::string Storage::execute_task(const TaskEntry& task, std::vector<LogEntry>& writes)
+{
+    // Keys handed to another server by a finished migration are redirected there. Text clients cannot
+    // follow a redirect, and quorum keys are placed by the clients, so both are served as before.
+    if ((task.req == GET || task.req == PUT) && task.format == WireFormat::BINARY)
+    {
+        const Membership* membership = current_membership.load(std::memory_order_acquire);
+        if (membership != nullptr)
+        {
+            const uint32_t owner = membership->owner(task.key);
+            if (owner != membership->self)
+            {
+                moved_count.fetch_add(1, std::memory_order_relaxed);
+                return format_response(task, protocol::MOVED, membership->names[owner]);
+            }
+        }
+    }
+
+    switch (task.req)
+    {
+        case GET:
+        case VGET:
+        case PUT:
+        case VPUT:
+        {
+            if (shards.empty())
+            {
+                return execute_key(table, task, writes);
+            }
+            // Only requests the filter could not steer (text ones) land on a shard that does not own the key
+            if (shard_of(task.key) != current_shard)
+            {
+                handoff_count.fetch_add(1, std::memory_order_relaxed);
+            }
+            std::string response;
+            with_key_table(task.key, [&](auto& target) { response = execute_key(target, task, writes); });
+            return response;
+        }
+        case MGET:
+        case MPUT:
+        case REPLICATE:
+            return execute_multi(task, writes);
+        case MIGRATE:
+            return start_migration(task);
+        case GOSSIP:
+            // An empty response means there is nothing to send back
+            return gossip ? gossip->handle(task.flags, task.request_id, task.key, task.value.value(), task.client_addr)
+                          : std::string{};
+        case MEMBERS:
+            return list_members(task);
+        case STATS:
+            return format_response(task, protocol::OK, collect_stats((task.flags & protocol::STATS_PROMETHEUS) != 0));
+        case COPY:
+            // Not acked: the owner pushes again every refresh while the key stays hot
+            return apply_copies(task);
+    }
+    return {};
+}
+
+template <typename Table>
+std::string Storage::execute_key(Table& target, const TaskEntry& task, std::vector<LogEntry>& writes)
+{
+    protocol::Status status = protocol::OK;
+    std::string value;
+    uint64_t version = 0;
+
+    switch (task.req)
+    {
+        case GET:
+        case VGET:
+        {
+            const bool found = target.if_contains(task.key, [&value, &version](const auto& item) {
+                value = item.second.value;
+                version = item.second.version;
+            });
+            status = found ? protocol::OK : protocol::NOT_FOUND;
+            break;
+        }
+        case PUT:
+        {
+            bool inserted = false;
+            std::string existing;
+            if (task.value.has_value())
+            {
+                inserted = target.try_emplace_l(
+                    task.key,
+                    [&existing, this](const auto& item) {
+                        if (holds_replies())
+                        {
+                            existing = item.second.value;
+                        }
+                    },
+                    StoredValue{task.value.value()}
+                );
+            }
+            if (inserted)
+            {
+                writes.push_back(LogEntry{task.key, task.value.value()});
+            }
+            else if (task.value.has_value() && holds_replies())
+            {
+                // The key may be here but not yet downstream (e.g. a client retry after a lost reply);
+                // re-shipping it makes even the NOT_STORED answer wait until the replicas have it
+                writes.push_back(LogEntry{task.key, std::move(existing)});
+            }
+            status = inserted ? protocol::OK : protocol::NOT_STORED;
+            break;
+        }
+        case VPUT:
+        {
+            // Always OK: the replica now holds this version or a newer one, which the reply reports
+            // try_emplace_l returns false when the key exists, even if the lambda replaced an older version
+            bool updated = false;
+            const bool inserted = target.try_emplace_l(
+                task.key,
+                [&task, &version, &updated](auto& item) {
+                    if (task.version > item.second.version)
+                    {
+                        item.second.value = task.value.value();
+                        item.second.version = task.version;
+                        updated = true;
+                    }
+                    version = item.second.version;
+                },
+                StoredValue{task.value.value(), task.version}
+            );
+            if (inserted || updated)
+            {
+                version = task.version;
+                writes.push_back(LogEntry{task.key, task.value.value(), task.version});
+            }
+            break;
+        }
+        default:
+            break;
+    }
+
+    return format_response(task, status, std::move(value), version);
+}
+
+std::string Storage::execute_multi(const TaskEntry& task, std::vector<LogEntry>& writes)
+{
+    const std::string_view packed = task.value.has_value() ? std::string_view(task.value.value()) : std::string_view{};
+    std::vector<std::pair<std::string_view, std::string_view>> entries;
+    int unpacked = 0;
+    if (task.req == MGET)
+    {
+        std::vector<std::string_view> keys;
+        unpacked = protocol::unpack_keys(packed, keys);
+        for (const std::string_view key : keys)
+        {
+            entries.emplace_back(key, std::string_view{});
+        }
+    }
+    else
+    {
+        unpacked = protocol::unpack_pairs(packed, entries);
+    }
+
+    if (unpacked == -1)
+    {
+        return format_response(task, protocol::BAD_REQUEST, {});
+    }
+
+    struct Slot
+    {
+        size_t shard;
+        size_t submap;
+        size_t hash;
+        size_t index;
+    };
+
+    std::vector<Slot> slots(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        const size_t hash = table.hash(entries[i].first);
+        slots[i] = Slot{shards.empty() ? 0 : shard_of(entries[i].first), HashTable::subidx(hash), hash, i};
+    }
+    std::ranges::sort(slots, {}, [](const Slot& slot) { return std::pair(slot.shard, slot.submap); });
+
+    // Entries for keys that migrated away are answered MOVED; the client resolves them one by one
+    std::vector<protocol::Status> statuses(entries.size(), protocol::OK);
+    const Membership* membership = task.req == REPLICATE ? nullptr : current_membership.load(std::memory_order_acquire);
+    if (membership != nullptr)
+    {
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            if (membership->owner(entries[i].first) != membership->self)
+            {
+                statuses[i] = protocol::MOVED;
+                moved_count.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Same semantics as the single-key path (PUT never overwrites), but each submap lock is taken once.
+    // REPLICATE mirrors whatever the primary accepted, so it overwrites, and is passed further down
+    // when this node is itself in the middle of a chain.
+    std::vector<std::string> values(task.req == MGET ? entries.size() : 0);
+    const auto apply = [&](auto& target, const size_t first, const size_t last, std::vector<LogEntry>& applied) {
+        for (size_t begin = first; begin < last;)
+        {
+            size_t end = begin;
+            while (end < last && slots[end].submap == slots[begin].submap)
+            {
+                ++end;
+            }
+
+            target.with_submap_m(slots[begin].submap, [&](auto& set) {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const Slot& slot = slots[i];
+                    if (statuses[slot.index] == protocol::MOVED)
+                    {
+                        continue;
+                    }
+                    const auto& [key, value] = entries[slot.index];
+                    const auto it = set.find(key, slot.hash);
+                    if (task.req == MGET)
+                    {
+                        if (it == set.end())
+                        {
+                            statuses[slot.index] = protocol::NOT_FOUND;
+                        }
+                        else
+                        {
+                            values[slot.index] = it->second.value;
+                        }
+                    }
+                    else if (task.req == REPLICATE)
+                    {
+                        if (it == set.end())
+                        {
+                            set.emplace_with_hash(slot.hash, std::string(key), StoredValue{std::string(value)});
+                        }
+                        else if ((task.flags & protocol::REPLICATE_FILL) == 0)
+                        {
+                            it->second.value.assign(value);
+                        }
+                        else
+                        {
+                            continue;  // Already here, so at least as new as this copy
+                        }
+                        applied.push_back(LogEntry{std::string(key), std::string(value)});
+                    }
+                    else if (it != set.end())
+                    {
+                        statuses[slot.index] = protocol::NOT_STORED;
+                        if (holds_replies())
+                        {
+                            applied.push_back(LogEntry{std::string(key), it->second.value});
+                        }
+                    }
+                    else
+                    {
+                        set.emplace_with_hash(slot.hash, std::string(key), StoredValue{std::string(value)});
+                        applied.push_back(LogEntry{std::string(key), std::string(value)});
+                    }
+                }
+            });
+            begin = end;
+        }
+    };
+
+    if (shards.empty())
+    {
+        apply(table, 0, slots.size(), writes);
+    }
+    else
+    {
+        // Each owning shard applies its run of the batch on its own thread; the runs touch disjoint entries
+        std::vector<size_t> owners;
+        std::vector<std::pair<size_t, size_t>> runs(shards.size());
+        std::vector<std::vector<LogEntry>> applied(shards.size());
+        for (size_t begin = 0; begin < slots.size();)
+        {
+            size_t end = begin;
+            while (end < slots.size() && slots[end].shard == slots[begin].shard)
+            {
+                ++end;
+            }
+            owners.push_back(slots[begin].shard);
+            runs[slots[begin].shard] = {begin, end};
+            begin = end;
+        }
+        if (!on_shards(owners, [&](ShardTable& target, const size_t shard) {
+                apply(target, runs[shard].first, runs[shard].second, applied[shard]);
+            }))
+        {
+            return {};
+        }
+        for (auto& shard_writes : applied)
+        {
+            std::ranges::move(shard_writes, std::back_inserter(writes));
+        }
+    }
+
+    // The primary only needs to know the batch landed
+    if (task.req == REPLICATE)
+    {
+        return format_response(task, protocol::OK, {});
+    }
+
+    // Every entry gets at least its fixed-size slot (requests are capped at MAX_REQUEST_SIZE, so these
+    // always fit); values that would overflow the datagram are marked TRUNCATED for the client to refetch
+    const size_t fixed = entries.size() * protocol::packed_result_size(task.req, {});
+    size_t room = protocol::MAX_RESPONSE_SIZE - protocol::HEADER_SIZE - fixed;
+    std::string results;
+    results.reserve(fixed);
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (task.req == MGET && statuses[i] == protocol::OK)
+        {
+            if (values[i].size() > room)
+            {
+                protocol::pack_result(results, task.req, protocol::TRUNCATED, {});
+                continue;
+            }
+            room -= values[i].size();
+            protocol::pack_result(results, task.req, protocol::OK, values[i]);
+            continue;
+        }
+        protocol::pack_result(results, task.req, statuses[i], {});
+    }
+
+    return format_response(task, protocol::OK, std::move(results));
+}
+
+std::string Storage::format_response(const TaskEntry& task, const protocol::Status status, std::string value,
+                                     const uint64_t version)
+{
+    if (task.format == WireFormat::TEXT)
+    {
+        // Legacy replies: the value (empty when missing) for GET, TRUE/FALSE for PUT
+        if (task.req == PUT)
+        {
+            return status == protocol::OK ? "TRUE" : "FALSE";
+        }
+        return value;
+    }
+
+    protocol::Header header;
+    header.opcode = task.req;
+    header.status = status;
+    header.request_id = task.request_id;
+
+    std::string response;
+    const bool versioned = task.req == VGET || task.req == VPUT || task.req == MEMBERS;
+    protocol::encode(response, header, versioned ? protocol::pack_version(version) : std::string{}, {}, value);
+    return response;
+}
+
+bool Storage::ship_writes(std::vector<LogEntry>& writes, const sockaddr_in& client_addr, std::string& response)
+{
+    forward_writes(writes);
+    if (writes.empty() || !replicator)
+    {
+        writes.clear();
+        return false;
+    }
+
+    if (replicator->holds_replies())
+    {
+        replicator->replicate(std::move(writes), ResponseEntry{client_addr, std::move(response)});
+        writes.clear();
+        return true;
+    }
+
+    replicator->replicate(std::move(writes), std::nullopt);
+    writes.clear();
+    return false;
+}
+
+void Storage::forward_writes(const std::vector<LogEntry>& writes) const
+{
+    // Loaded after the writes were applied under their submap locks: either the migration's copy of
+    // that submap saw the write, or the copy finished first and this load sees the new layout
+    const Membership* target = target_membership.load(std::memory_order_acquire);
+    if (target == nullptr)
+    {
+        return;
+    }
+
+    for (const LogEntry& write : writes)
+    {
+        // Quorum keys stay where the clients put them
+        const uint32_t owner = target->owner(write.key);
+        if (write.version == 0 && owner != target->self)
+        {
+            target->forwarders[owner]->replicate({write}, std::nullopt);
+        }
+    }
+}
+
+std::string Storage::start_migration(const TaskEntry& task)
+{
+    // The value lists the complete new layout as "ip:port|ip:port|..." and the key names this server
+    // in it. Replies say "migrating" or "done", so an admin can repeat the request to poll for progress.
+    std::vector<sockaddr_in> addrs;
+    auto next = std::make_unique<Membership>(config.virtual_nodes);
+    const std::string_view list = task.value.has_value() ? std::string_view(task.value.value()) : std::string_view{};
+    for (size_t begin = 0; begin <= list.size();)
+    {
+        const size_t end = std::min(list.find('|', begin), list.size());
+        sockaddr_in addr{};
+        if (parse_endpoint(list.substr(begin, end - begin), config.port, addr) == -1)
+        {
+            return format_response(task, protocol::BAD_REQUEST, {});
+        }
+        addrs.push_back(addr);
+        next->names.push_back(endpoint_name(addr));
+        next->layout += (next->layout.empty() ? "" : "|") + next->names.back();
+        begin = end + 1;
+    }
+
+    sockaddr_in self_addr{};
+    if (parse_endpoint(task.key, config.port, self_addr) == -1)
+    {
+        return format_response(task, protocol::BAD_REQUEST, {});
+    }
+    const auto self = std::ranges::find(next->names, endpoint_name(self_addr));
+    if (self == next->names.end())
+    {
+        return format_response(task, protocol::BAD_REQUEST, {});
+    }
+    next->self = static_cast<uint32_t>(self - next->names.begin());
+
+    std::lock_guard lock(migration_mutex);
+    const Membership* target = target_membership.load(std::memory_order_relaxed);
+    const bool same_layout = target != nullptr && target->layout == next->layout;
+    if (migrating)
+    {
+        // One migration at a time; a different layout has to wait for this one to finish
+        return same_layout ? format_response(task, protocol::OK, "migrating")
+                           : format_response(task, protocol::NOT_STORED, {});
+    }
+    if (same_layout && !migration_failed)
+    {
+        return format_response(task, protocol::OK, "done");
+    }
+
+    for (size_t node = 0; node < addrs.size(); ++node)
+    {
+        next->ring.add_node(static_cast<uint32_t>(node), next->names[node]);
+        next->forwarders.emplace_back();
+        if (node == next->self)
+        {
+            continue;
+        }
+        // Plain PUTs never overwrite, so a copied key that is already there is as new as the copy; filling
+        // only missing keys keeps a snapshot that lands late from replacing what was forwarded since
+        next->forwarders.back() = std::make_unique<Replicator>(std::vector<sockaddr_in>{addrs[node]}, Durability::ASYNC,
+                                                               protocol::REPLICATE_FILL);
+        if (next->forwarders.back()->start(server_fds.front()) != 0)
+        {
+            return format_response(task, protocol::NOT_STORED, {});
+        }
+    }
+
+    if (migration_thread.joinable())
+    {
+        migration_thread.join();
+    }
+    migrating = true;
+    migration_failed = false;
+    memberships.push_back(std::move(next));
+    target_membership.store(memberships.back().get(), std::memory_order_release);
+    migration_thread = std::thread(&Storage::migrate, this, memberships.back().get());
+    return format_response(task, protocol::OK, "migrating");
+}
+
+bool Storage::drain_forwarders(const Membership& membership, const uint64_t limit) const
+{
+    constexpr std::chrono::microseconds POLL{100};
+    for (const auto& forwarder : membership.forwarders)
+    {
+        while (forwarder && forwarder->get_outstanding_writes() > limit)
+        {
+            if (!running.load(std::memory_order_relaxed))
+            {
+                return false;
+            }
+            std::this_thread::sleep_for(POLL);
+        }
+    }
+
+    for (const auto& forwarder : membership.forwarders)
+    {
+        if (forwarder && forwarder->get_failed_batches() > 0)
+        {
+            return false;
+        }
+    }
+    return true;
 }
 
-int Storage::create_server(int& server_fd) const
+void Storage::migrate(const Membership* next)
 {
-    server_fd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (server_fd == -1)
+    // Bounded so a large table does not flood the destinations' receive buffers
+    constexpr uint64_t WINDOW = 1024;
+
+    const auto start = std::chrono::steady_clock::now();
+    const Membership* previous = current_membership.load(std::memory_order_relaxed);
+    std::vector<std::vector<LogEntry>> moving(next->names.size());
+    bool ok = true;
+
+    // Copy out one submap at a time so no lock is held while sending. Writes after a submap was copied
+    // are still served here and forwarded as well (forward_writes), since the target is already published.
+    // Shards copy out the submap of their own tables at once and gather what they found under the lock.
+    std::mutex moving_mutex;
+    for (size_t submap = 0; submap < HashTable::subcnt() && ok; ++submap)
     {
-        return -1;
+        ok = with_tables([&](auto& target, size_t) {
+            std::vector<std::pair<uint32_t, LogEntry>> found;
+            target.with_submap(submap, [&](const auto& set) {
+                for (const auto& [key, stored] : set)
+                {
+                    // Quorum keys live on N ring owners chosen by the clients and are never redirected,
+                    // so they are neither shipped nor dropped
+                    const uint32_t owner = next->owner(key);
+                    if (stored.version == 0 && owner != next->self)
+                    {
+                        found.emplace_back(owner, LogEntry{key, stored.value});
+                    }
+                }
+            });
+            std::lock_guard lock(moving_mutex);
+            for (auto& [owner, entry] : found)
+            {
+                moving[owner].push_back(std::move(entry));
+            }
+        });
+
+        // A shipment never straddles REPLICATE datagrams, so each one is cut to fit in a single datagram
+        for (uint32_t node = 0; node < moving.size() && ok; ++node)
+        {
+            std::vector<LogEntry>& writes = moving[node];
+            size_t begin = 0;
+            while (begin < writes.size() && ok)
+            {
+                size_t end = begin;
+                size_t size = protocol::HEADER_SIZE;
+                do
+                {
+                    size += protocol::packed_pair_size(writes[end].key, writes[end].value);
+                    ++end;
+                } while (end < writes.size() &&
+                         size + protocol::packed_pair_size(writes[end].key, writes[end].value) <= protocol::MAX_REQUEST_SIZE);
+
+                next->forwarders[node]->replicate(std::vector<LogEntry>(std::make_move_iterator(writes.begin() + begin),
+                                                                        std::make_move_iterator(writes.begin() + end)),
+                                                  std::nullopt);
+                migrated_keys.fetch_add(end - begin, std::memory_order_relaxed);
+                ok = drain_forwarders(*next, WINDOW);
+                begin = end;
+            }
+            writes.clear();
+        }
     }
 
-    sockaddr_in addr{};
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(port);
+    // Cut over once the copy has landed: from here on clients are redirected, so the only writes still
+    // being forwarded are those that were already in flight, and the forwarders drain completely
+    if (ok && drain_forwarders(*next, WINDOW))
+    {
+        current_membership.store(next, std::memory_order_release);
+        ok = drain_forwarders(*next, 0);
+    }
+    else
+    {
+        target_membership.store(previous, std::memory_order_release);
+    }
 
-    if (bind(server_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1)
+    // Local copies are only dropped once every destination acknowledged them
+    if (ok)
     {
-        close(server_fd);
-        return -1;
+        for (size_t submap = 0; submap < HashTable::subcnt(); ++submap)
+        {
+            with_tables([&](auto& target, size_t) {
+                target.with_submap_m(submap, [&](auto& set) {
+                    for (auto it = set.begin(); it != set.end();)
+                    {
+                        if (it->second.version == 0 && next->owner(it->first) != next->self)
+                        {
+                            set.erase(it++);
+                        }
+                        else
+                        {
+                            ++it;
+                        }
+                    }
+                });
+            });
+        }
     }
 
-    return 0;
+    migration_ms.store(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(),
+                       std::memory_order_relaxed);
+    std::lock_guard lock(migration_mutex);
+    migrating = false;
+    migration_failed = !ok;
 }
 
-void Storage::receive(const int server_fd)
+std::string Storage::list_members(const TaskEntry& task) const
 {
-    constexpr size_t BUFFER_SIZE = 1024;
-    char buffer[BUFFER_SIZE];
+    if (!gossip)
+    {
+        return format_response(task, protocol::BAD_REQUEST, {});
+    }
 
-    timeval tv{};
-    tv.tv_sec = 0;
-    tv.tv_usec = 50000;  // 50ms
-    setsockopt(server_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    std::vector<std::string> names;
+    const uint64_t version = gossip->snapshot(names);
+    std::string packed;
+    for (const std::string& name : names)
+    {
+        protocol::pack_key(packed, name);
+    }
+    return format_response(task, protocol::OK, std::move(packed), version);
+}
 
-    while (running.load(std::memory_order_relaxed))
+namespace
+{
+// Renders metrics as "name{labels} value" lines; the Prometheus flavour prefixes the names and
+// declares each metric's type once
+class StatsWriter
+{
+    std::string out;
+    bool prometheus;
+
+public:
+    explicit StatsWriter(const bool prometheus) : prometheus(prometheus) {}
+
+    void declare(const std::string_view name, const std::string_view type, const std::string_view help)
+    {
+        if (prometheus)
+        {
+            out.append("# HELP dht_").append(name).append(" ").append(help).append("\n");
+            out.append("# TYPE dht_").append(name).append(" ").append(type).append("\n");
+        }
+    }
+
+    template <typename Value>
+    void add(const std::string_view name, const std::string_view labels, const Value value)
+    {
+        if (prometheus)
+        {
+            out.append("dht_");
+        }
+        out.append(name);
+        if (!labels.empty())
+        {
+            out.append("{").append(labels).append("}");
+        }
+        // Shortest round-trip form, so sub-microsecond latencies in seconds keep their digits
+        char digits[32];
+        const char* end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+        out.append(" ").append(digits, static_cast<size_t>(end - digits)).append("\n");
+    }
+
+    template <typename Value>
+    void metric(const std::string_view name, const std::string_view type, const std::string_view help, const Value value)
     {
-        sockaddr_in client_addr{};
-        socklen_t client_len = sizeof(client_addr);
+        declare(name, type, help);
+        add(name, {}, value);
+    }
 
-        const ssize_t bytes_received = recvfrom(server_fd, buffer, BUFFER_SIZE - 1, 0,
-                                        reinterpret_cast<sockaddr*>(&client_addr), &client_len);
+    std::string take() { return std::move(out); }
+};
 
-        if (bytes_received == -1)
+// Keys are arbitrary bytes; label values only escape backslash, quote and newline, so anything else
+// unprintable is replaced
+std::string escape_label(const std::string_view value)
+{
+    std::string escaped;
+    for (const char c : value)
+    {
+        if (c == '\\' || c == '"')
         {
-            continue;
+            escaped.push_back('\\');
+            escaped.push_back(c);
+        }
+        else if (c == '\n')
+        {
+            escaped.append("\\n");
+        }
+        else
+        {
+            escaped.push_back(c >= 0x20 && c < 0x7f ? c : '?');
         }
+    }
+    return escaped;
+}
+}
 
-        buffer[bytes_received] = '\0';
-        const std::string input(buffer);
+std::string Storage::collect_stats(const bool prometheus)
+{
+    // Everything here is an atomic load, a queue size estimate, a brief per-submap lock or a merge of
+    // the per-thread histograms, so a scrape never stalls the request path
+    StatsWriter writer(prometheus);
+    writer.metric("received_total", "counter", "Requests received", get_received_count());
+    writer.metric("executed_total", "counter", "Requests executed", get_executed_count());
+    writer.metric("responded_total", "counter", "Replies sent", get_responded_count());
+    writer.metric("send_batches_total", "counter", "Send calls", get_send_batch_count());
+    writer.metric("task_queue_depth", "gauge", "Approximate tasks waiting for an executor", task_queue.size_approx());
+    writer.metric("response_queue_depth", "gauge", "Approximate replies waiting to be sent", response_queue.size_approx());
+    writer.metric("replicated_writes_total", "counter", "Writes shipped to backups", get_replicated_writes());
+    writer.metric("replication_failures_total", "counter", "Replication batches given up on", get_failed_replications());
+    writer.metric("replication_outstanding_writes", "gauge", "Shipped writes not yet acknowledged",
+                  replicator ? replicator->get_outstanding_writes() : 0);
+    writer.metric("migrated_keys_total", "counter", "Keys copied away by migrations", get_migrated_keys());
+    writer.metric("moved_total", "counter", "Requests answered MOVED", get_moved_count());
+    writer.metric("shard_handoffs_total", "counter", "Requests handed to the shard owning their key", get_handoff_count());
+    writer.metric("gossip_suspected_total", "counter", "Members suspected by this server", get_suspected_count());
+    writer.metric("gossip_dead_total", "counter", "Members declared dead by this server", get_dead_count());
 
-        Request req;
-        std::string key;
-        std::optional<std::string> value;
+    // With shards, every shard's table has its own submaps, labelled by shard as well
+    std::vector<std::pair<size_t, float>> submaps(HashTable::subcnt() * std::max<size_t>(shards.size(), 1));
+    with_tables([&submaps](const auto& target, const size_t index) {
+        for (size_t i = 0; i < HashTable::subcnt(); ++i)
+        {
+            target.with_submap(i, [&](const auto& set) {
+                submaps[index * HashTable::subcnt() + i] = {set.size(), set.load_factor()};
+            });
+        }
+    });
+    size_t total_size = 0;
+    for (const auto& [size, load_factor] : submaps)
+    {
+        total_size += size;
+    }
+    const auto submap_label = [this](const size_t i) {
+        const std::string label = "submap=\"" + std::to_string(i % HashTable::subcnt()) + "\"";
+        return shards.empty() ? label : "shard=\"" + std::to_string(i / HashTable::subcnt()) + "\"," + label;
+    };
+    writer.metric("table_size", "gauge", "Keys stored", total_size);
+    writer.declare("submap_size", "gauge", "Keys stored per submap");
+    for (size_t i = 0; i < submaps.size(); ++i)
+    {
+        writer.add("submap_size", submap_label(i), submaps[i].first);
+    }
+    writer.declare("submap_load_factor", "gauge", "Occupied fraction of each submap's slots");
+    for (size_t i = 0; i < submaps.size(); ++i)
+    {
+        writer.add("submap_load_factor", submap_label(i), submaps[i].second);
+    }
 
-        if (parse_req(input, req, key, value) == -1)
+    const std::shared_ptr<const HotKeySet> hot = get_hot_keys();
+    writer.metric("sampled_requests_per_second", "gauge", "Single-key request rate estimated by the hot key sampler",
+                  hot ? hot->sampled : 0);
+    writer.metric("hot_key_hints_total", "counter", "Reads flagged HOT_KEY as a caching hint", get_hot_key_hints());
+    writer.metric("leases_granted_total", "counter", "Leases granted on hot key reads", get_leases_granted());
+    writer.metric("copies_pushed_total", "counter", "Hot key copies sent to other servers", get_copies_pushed());
+    writer.metric("copy_reads_total", "counter", "Reads answered from another server's hot key copy", get_copy_reads());
+    writer.metric("leases_refused_total", "counter", "Leases refused because the key was written within a term",
+                  get_leases_refused());
+    writer.declare("hot_key_requests_per_second", "gauge", "Estimated request rate of the hottest keys");
+    if (hot)
+    {
+        for (const auto& [key, rate] : hot->top)
         {
-            continue;
+            const uint64_t hash = HashRing::hash(key);
+            const char* hinted = hot->contains(hash) ? "true" : "false";
+            const char* copied = hot->is_spread(hash) ? "true" : "false";
+            writer.add("hot_key_requests_per_second",
+                       "key=\"" + escape_label(key) + "\",hinted=\"" + hinted + "\",copied=\"" + copied + "\"", rate);
         }
+    }
 
-        task_queue.enqueue(TaskEntry{client_addr, req, std::move(key), std::move(value)});
-        received_count.fetch_add(1, std::memory_order_relaxed);
+    constexpr std::array<std::pair<Stage, const char*>, NUM_STAGES> stages{{
+        {Stage::RECEIVE, "receive"}, {Stage::QUEUE, "queue"}, {Stage::EXECUTE, "execute"}, {Stage::RESPOND, "respond"}}};
+    writer.declare("stage_latency_seconds", "summary", "Time requests spend in each server stage since startup");
+    for (const auto& [stage, name] : stages)
+    {
+        const LatencyHistogram::Summary summary = get_stage_latency(stage);
+        const std::string label = std::string("stage=\"") + name + "\"";
+        const std::array<std::pair<const char*, uint64_t>, 5> quantiles{{
+            {"0.5", summary.p50}, {"0.9", summary.p90}, {"0.99", summary.p99}, {"0.999", summary.p999}, {"1", summary.max}}};
+        for (const auto& [quantile, ns] : quantiles)
+        {
+            writer.add("stage_latency_seconds", label + ",quantile=\"" + quantile + "\"", static_cast<double>(ns) / 1e9);
+        }
+        writer.add("stage_latency_seconds_count", label, summary.count);
     }
+    return writer.take();
 }
 
 void Storage::execute()
 {
     constexpr size_t BULK_SIZE = 32;
     TaskEntry tasks[BULK_SIZE];
+    std::vector<LogEntry> writes;
+    unsigned idle_rounds = 0;
+    StageHistograms& latency = register_latencies();
+    HotKeyView hot = register_hot_keys();
     
     while (running.load(std::memory_order_relaxed))
     {
@@ -86,55 +1380,148 @@ void Storage::execute()
         
         if (count == 0)
         {
-            std::this_thread::sleep_for(std::chrono::microseconds(10));
+            task_waiter.wait(idle_rounds, [this] { return task_queue.size_approx() > 0; });
             continue;
         }
+        idle_rounds = 0;
         
+        // Tasks later in the batch keep queueing while earlier ones execute
+        uint64_t started = LatencyHistogram::now_ns();
         for (size_t i = 0; i < count; ++i)
         {
             TaskEntry& task = tasks[i];
-            std::string response;
+            latency[static_cast<size_t>(Stage::QUEUE)].record(started - task.stage_start_ns);
+            std::string response = execute_task(task, writes);
+            track_key(hot, task, writes, started, response);
+            executed_count.fetch_add(1, std::memory_order_relaxed);
+            const bool held = ship_writes(writes, task.client_addr, response);
+            const uint64_t finished = LatencyHistogram::now_ns();
+            latency[static_cast<size_t>(Stage::EXECUTE)].record(finished - started);
+            started = finished;
+            if (held || (response.empty() && task.format == WireFormat::BINARY))
+            {
+                continue;
+            }
+            ResponseEntry entry{task.client_addr, std::move(response)};
+            entry.queued_ns = finished;
+            response_queue.enqueue(std::move(entry));
+        }
+        response_waiter.notify();
+    }
+}
+
+template <typename Receiver, typename Sender>
+void Storage::serve_shard_with(Receiver& receiver, Sender& sender)
+{
+    TaskEntry task;
+    std::vector<LogEntry> writes;
+    std::vector<ResponseEntry> responses(config.recv_batch_size);
+    std::vector<iovec> iovecs(config.recv_batch_size);
+    std::vector<mmsghdr> msgs(config.recv_batch_size);
+    StageHistograms& latency = register_latencies();
+    HotKeyView hot = register_hot_keys();
+    Shard* own = current_shard == NO_SHARD ? nullptr : shards[current_shard].get();
+
+    // Receive, execute and reply on this core; only work on keys another shard owns crosses a thread boundary
+    while (running.load(std::memory_order_relaxed))
+    {
+        if (own != nullptr)
+        {
+            run_shard_jobs(*own);
+        }
 
-            switch (task.req)
+        size_t count = 0;
+        size_t held = 0;
+        receiver.receive([&](const std::string_view payload, const sockaddr_in& source) {
+            const uint64_t arrived = LatencyHistogram::now_ns();
+            if (parse_req(payload, task) == -1)
             {
-                case GET:
-                {
-                    std::string found_value;
-                    const bool found = table.if_contains(task.key, [&found_value](const auto& item) {
-                        found_value = item.second;
-                    });
-                    response = found ? found_value : "";
-                    break;
-                }
-                case PUT:
-                {
-                    if (task.value.has_value())
-                    {
-                        const bool inserted = table.try_emplace_l(
-                            task.key,
-                            [](auto&) {},
-                            task.value.value()
-                        );
-                        response = inserted ? "TRUE" : "FALSE";
-                    }
-                    else
-                    {
-                        response = "FALSE";
-                    }
-                    break;
-                }
+                return;
             }
 
-            response_queue.enqueue(ResponseEntry{task.client_addr, std::move(response)});
-            executed_count.fetch_add(1, std::memory_order_relaxed);
+            if (count == responses.size())
+            {
+                responses.emplace_back();
+                iovecs.emplace_back();
+                msgs.emplace_back();
+            }
+
+            const uint64_t started = LatencyHistogram::now_ns();
+            latency[static_cast<size_t>(Stage::RECEIVE)].record(started - arrived);
+            responses[count].client_addr = source;
+            responses[count].response = execute_task(task, writes);
+            track_key(hot, task, writes, started, responses[count].response);
+            const bool shipped = ship_writes(writes, source, responses[count].response);
+            responses[count].queued_ns = LatencyHistogram::now_ns();
+            latency[static_cast<size_t>(Stage::EXECUTE)].record(responses[count].queued_ns - started);
+            if (shipped || (responses[count].response.empty() && task.format == WireFormat::BINARY))
+            {
+                ++held;
+                return;
+            }
+            ++count;
+        });
+
+        received_count.fetch_add(count + held, std::memory_order_relaxed);
+        executed_count.fetch_add(count + held, std::memory_order_relaxed);
+        if (count == 0)
+        {
+            continue;
+        }
+
+        prepare_send(responses.data(), count, iovecs.data(), msgs.data());
+        responded_count.fetch_add(sender.send(msgs.data(), count), std::memory_order_relaxed);
+
+        const uint64_t now = LatencyHistogram::now_ns();
+        for (size_t i = 0; i < count; ++i)
+        {
+            latency[static_cast<size_t>(Stage::RESPOND)].record(now - responses[i].queued_ns);
         }
     }
+
+    // Other threads may still be waiting on this shard's table
+    while (own != nullptr && shard_waiters.load() > 0)
+    {
+        run_shard_jobs(*own);
+        std::this_thread::yield();
+    }
 }
 
-void Storage::respond(const int server_fd)
+void Storage::serve_shard(const int server_fd, const size_t shard)
+{
+    pin_to_core(shard);
+    if (!shards.empty())
+    {
+        current_shard = shard;
+    }
+
+    if (config.io_backend == IoBackend::IO_URING)
+    {
+        UringReceiver receiver;
+        UringSender sender;
+        if (receiver.init(server_fd, config.recv_batch_size) == 0 &&
+            sender.init(server_fd, config.recv_batch_size, send_batch_count) == 0)
+        {
+            serve_shard_with(receiver, sender);
+            return;
+        }
+        active_backend.store(IoBackend::SOCKETS, std::memory_order_relaxed);
+    }
+
+    SocketReceiver receiver(server_fd, config.recv_batch_size);
+    SocketSender sender(server_fd, send_batch_count);
+    serve_shard_with(receiver, sender);
+}
+
+template <typename Sender>
+void Storage::respond_with(Sender& sender)
 {
     constexpr size_t BULK_SIZE = 32;
     ResponseEntry responses[BULK_SIZE];
+    std::array<iovec, BULK_SIZE> iovecs{};
+    std::array<mmsghdr, BULK_SIZE> msgs{};
+    unsigned idle_rounds = 0;
+    StageHistograms& latency = register_latencies();
     
     while (running.load(std::memory_order_relaxed))
     {
@@ -142,25 +1529,117 @@ void Storage::respond(const int server_fd)
         
         if (count == 0)
         {
-            std::this_thread::sleep_for(std::chrono::microseconds(10));
+            response_waiter.wait(idle_rounds, [this] { return response_queue.size_approx() > 0; });
             continue;
         }
+        idle_rounds = 0;
+
+        prepare_send(responses, count, iovecs.data(), msgs.data());
+        const size_t sent = sender.send(msgs.data(), count);
+        responded_count.fetch_add(sent, std::memory_order_relaxed);
 
+        const uint64_t now = LatencyHistogram::now_ns();
         for (size_t i = 0; i < count; ++i)
         {
-            ResponseEntry& resp = responses[i];
-            sendto(server_fd, resp.response.c_str(), resp.response.size(), 0,
-                   reinterpret_cast<const sockaddr*>(&resp.client_addr),
-                   sizeof(resp.client_addr));
-            responded_count.fetch_add(1, std::memory_order_relaxed);
+            latency[static_cast<size_t>(Stage::RESPOND)].record(now - responses[i].queued_ns);
+        }
+    }
+}
+
+void Storage::respond(const int server_fd)
+{
+    constexpr size_t BULK_SIZE = 32;
+
+    if (config.io_backend == IoBackend::IO_URING)
+    {
+        UringSender sender;
+        if (sender.init(server_fd, BULK_SIZE, send_batch_count) == 0)
+        {
+            respond_with(sender);
+            return;
+        }
+        active_backend.store(IoBackend::SOCKETS, std::memory_order_relaxed);
+    }
+
+    SocketSender sender(server_fd, send_batch_count);
+    respond_with(sender);
+}
+
+int Storage::parse_req(const std::string_view input, TaskEntry& task)
+{
+    if (protocol::is_binary(input))
+    {
+        return parse_binary_req(input, task);
+    }
+
+    task.format = WireFormat::TEXT;
+    task.request_id = 0;
+    return parse_text_req(input, task.req, task.key, task.value);
+}
+
+int Storage::parse_binary_req(const std::string_view input, TaskEntry& task)
+{
+    protocol::Message message;
+    if (protocol::decode(input, message) == -1)
+    {
+        return -1;
+    }
+
+    switch (message.header.opcode)
+    {
+        case GET:
+        case VGET:
+            task.value = std::nullopt;
+            break;
+        case VPUT:
+            if (protocol::unpack_version(message.extras, task.version) == -1)
+            {
+                return -1;
+            }
+            task.value.emplace(message.value);
+            break;
+        case PUT:
+        case MGET:
+        case MPUT:
+        case REPLICATE:
+        case GOSSIP:
+            task.value.emplace(message.value);
+            break;
+        case STATS:
+        case MEMBERS:
+            task.value = std::nullopt;
+            break;
+        case COPY:
+        {
+            uint32_t lifetime_us = 0;
+            if (protocol::unpack_lease(message.extras, lifetime_us) == -1)
+            {
+                return -1;
+            }
+            task.version = lifetime_us;
+            task.value.emplace(message.value);
+            break;
         }
+        case MIGRATE:
+            // Multi-key requests keep their packed entries in the value until execution
+            task.value.emplace(message.value);
+            break;
+        default:
+            return -1;
     }
+
+    task.format = WireFormat::BINARY;
+    task.req = message.header.opcode;
+    task.flags = message.header.flags;
+    task.request_id = message.header.request_id;
+    task.key.assign(message.key);
+    return 0;
 }
 
-int Storage::parse_req(const std::string& input, Request& req, std::string& key, std::optional<std::string>& value)
+int Storage::parse_text_req(const std::string_view input, Request& req, std::string& key, std::optional<std::string>& value)
 {
     const size_t first_colon = input.find(':');
-    if (first_colon == std::string::npos)
+    if (first_colon == std::string_view::npos)
     {
         return -1;
     }
@@ -170,7 +1649,7 @@ int Storage::parse_req(const std::string& input, Request& req, std::string& key,
     if (cmd == "GET")
     {
         req = GET;
-        key = input.substr(first_colon + 1);
+        key.assign(input.substr(first_colon + 1));
         value = std::nullopt;
         return 0;
     }
@@ -178,33 +1657,108 @@ int Storage::parse_req(const std::string& input, Request& req, std::string& key,
     if (cmd == "PUT")
     {
         const size_t second_colon = input.find(':', first_colon + 1);
-        if (second_colon == std::string::npos)
+        if (second_colon == std::string_view::npos)
         {
             return -1;
         }
         req = PUT;
-        key = input.substr(first_colon + 1, second_colon - first_colon - 1);
-        value = input.substr(second_colon + 1);
+        key.assign(input.substr(first_colon + 1, second_colon - first_colon - 1));
+        value.emplace(input.substr(second_colon + 1));
         return 0;
     }
 
     return -1;
 }
 
+void Storage::close_servers()
+{
+    for (const int fd : server_fds)
+    {
+        close(fd);
+    }
+    server_fds.clear();
+}
+
 void Storage::run()
 {
-    if (create_server(server_fd) != 0)
+    const bool sharded = config.engine == StorageEngine::SHARDED;
+    const size_t num_sockets = sharded ? config.num_shards : config.num_receivers;
+
+    // With several sockets the kernel spreads datagrams across the REUSEPORT group by flow hash
+    const bool reuse_port = num_sockets > 1;
+
+    for (size_t i = 0; i < num_sockets; ++i)
     {
-        return;
+        int fd = -1;
+        if (create_server(fd, reuse_port) != 0)
+        {
+            close_servers();
+            return;
+        }
+        server_fds.push_back(fd);
+    }
+
+    // Shards only get private tables once the kernel steers every key to a single one of them; a wakeup
+    // names its shard in one byte. Without the filter they all share the locked table.
+    if (sharded && shards.empty() && num_sockets <= 256 &&
+        (num_sockets == 1 || attach_key_steering(server_fds.front(), num_sockets) == 0))
+    {
+        for (const int fd : server_fds)
+        {
+            shards.push_back(std::make_unique<Shard>());
+            shards.back()->fd = fd;
+        }
     }
     
+    if (!config.replicas.empty())
+    {
+        replicator = std::make_unique<Replicator>(config.replicas, config.durability);
+        if (replicator->start(server_fds.front()) != 0)
+        {
+            replicator.reset();
+            close_servers();
+            return;
+        }
+    }
+
+    if (!config.seeds.empty())
+    {
+        self_name = config.advertise.empty() ? "127.0.0.1:" + std::to_string(config.port) : config.advertise;
+        gossip = std::make_unique<Gossip>(self_name, config.seeds);
+        if (gossip->start() != 0)
+        {
+            gossip.reset();
+            close_servers();
+            return;
+        }
+    }
+
+    active_backend.store(config.io_backend, std::memory_order_relaxed);
     running.store(true, std::memory_order_relaxed);
+    hot_key_thread = std::thread(&Storage::maintain_hot_keys, this);
 
-    workers[0] = std::thread(&Storage::receive, this, server_fd);
-    workers[1] = std::thread(&Storage::execute, this);
-    workers[2] = std::thread(&Storage::execute, this);
-    workers[3] = std::thread(&Storage::execute, this);
-    workers[4] = std::thread(&Storage::respond, this, server_fd);
+    if (sharded)
+    {
+        workers.reserve(num_sockets);
+        for (size_t i = 0; i < num_sockets; ++i)
+        {
+            workers.emplace_back(&Storage::serve_shard, this, server_fds[i], i);
+        }
+    }
+    else
+    {
+        workers.reserve(config.num_receivers + config.num_executors + 1);
+        for (const int fd : server_fds)
+        {
+            workers.emplace_back(&Storage::receive, this, fd);
+        }
+        for (size_t i = 0; i < config.num_executors; ++i)
+        {
+            workers.emplace_back(&Storage::execute, this);
+        }
+        // Any socket in the group carries the server's port, so replies can leave through the first one
+        workers.emplace_back(&Storage::respond, this, server_fds.front());
+    }
 
     for (auto& worker : workers)
     {
@@ -213,31 +1767,47 @@ void Storage::run()
             worker.join();
         }
     }
-    
-    close(server_fd);
-    server_fd = 0;
-}
+    workers.clear();
 
-void Storage::stop()
-{
-    if (!running.load(std::memory_order_relaxed))
+    // Before gossip, whose members it reads, and while server_fds are still open for its pushes
+    hot_key_thread.join();
+
+    if (gossip)
     {
-        return;
+        gossip->stop();
+        gossip->join();
     }
-    
-    running.store(false, std::memory_order_relaxed);
 
-    for (auto& worker : workers)
+    // Stopped after the executors so nothing is queued behind its back; it still sends through server_fds
+    if (replicator)
     {
-        if (worker.joinable())
+        replicator->stop();
+        replicator->join();
+    }
+    if (migration_thread.joinable())
+    {
+        migration_thread.join();
+    }
+    for (const auto& membership : memberships)
+    {
+        for (const auto& forwarder : membership->forwarders)
         {
-            worker.join();
+            if (forwarder)
+            {
+                forwarder->stop();
+                forwarder->join();
+            }
         }
     }
     
-    if (server_fd != 0)
-    {
-        close(server_fd);
-        server_fd = 0;
-    }
-}
\ No newline at end of file
+    close_servers();
+}
+
+void Storage::stop()
+{
+    // Only flips the flag and pokes parked threads, so it is safe to call from a signal handler;
+    // run() joins the workers
+    running.store(false, std::memory_order_relaxed);
+    task_waiter.notify_all();
+    response_waiter.notify_all();
+}
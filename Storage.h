@@ -2,8 +2,23 @@
 #define DISTIBUTED_HASH_TABLE_STORAGE_H
 
 #include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <netinet/in.h>
+#include <span>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
 
+#include "Gossip.h"
+#include "HashRing.h"
+#include "HotKeys.h"
+#include "IdleWaiter.h"
+#include "LatencyHistogram.h"
+#include "NetIo.h"
+#include "Protocol.h"
+#include "Replicator.h"
 #include "ds/concurrentqueue.h"
 #include "ds/HashMap/phmap.hpp"
 #include "Request.h"
@@ -14,51 +29,239 @@ struct TaskEntry
     Request req{};
     std::string key;
     std::optional<std::string> value;
+    WireFormat format = WireFormat::TEXT;  // Replies go back in the format the request arrived in
+    uint64_t request_id = 0;
+    uint64_t version = 0;                  // VPUT: the version; COPY: how long the copies last, in microseconds
+    uint8_t flags = 0;                     // GOSSIP: the message type; STATS: the report format
+    uint64_t stage_start_ns = 0;           // When it entered its current stage (LatencyHistogram::now_ns)
 
     TaskEntry() = default;
     TaskEntry(const sockaddr_in& addr, Request r, std::string k, std::optional<std::string> v)
         : client_addr(addr), req(r), key(std::move(k)), value(std::move(v)) {}
 };
 
-struct ResponseEntry
+// Quorum writes are ordered by version (last writer wins); plain PUTs store version 0
+struct StoredValue
 {
-    sockaddr_in client_addr{};
-    std::string response;
+    std::string value;
+    uint64_t version = 0;
+};
+
+enum class StorageEngine
+{
+    PIPELINE,  // receive -> task_queue -> execute -> response_queue -> respond
+    SHARDED,   // one run-to-completion thread per core, no cross-thread queues
+};
 
-    ResponseEntry() = default;
-    ResponseEntry(const sockaddr_in& addr, std::string resp)
-        : client_addr(addr), response(std::move(resp)) {}
+// Where a request spends its time inside the server; see Storage::get_stage_latency
+enum class Stage
+{
+    RECEIVE,  // From the receive call handing over the datagram to the task being queued (or executed)
+    QUEUE,    // Waiting in task_queue and in the executor's batch; pipeline engine only
+    EXECUTE,  // execute_task, including handing writes to the replicator
+    RESPOND,  // From the reply being produced until the send returns, including response_queue
+};
+constexpr size_t NUM_STAGES = 4;
+
+struct StorageConfig
+{
+    uint16_t port = 1895;
+    size_t recv_batch_size = 32;  // Datagrams pulled per recvmmsg call
+    size_t num_receivers = 1;     // >1 binds one SO_REUSEPORT socket per receive thread
+    size_t num_executors = 3;
+    StorageEngine engine = StorageEngine::PIPELINE;
+    size_t num_shards = 0;        // SHARDED only; 0 means one per hardware thread
+    IoBackend io_backend = IoBackend::SOCKETS;
+    WaitPolicy wait_policy = WaitPolicy::ADAPTIVE;  // How execute/respond idle on empty queues
+    // Backups that receive this node's writes. Chain replication is a single SYNC replica (the
+    // successor) on every node but the tail: each node forwards what it applies and only acks its
+    // predecessor once the rest of the chain has, so the head replies after the tail has the write.
+    std::vector<sockaddr_in> replicas{};
+    Durability durability = Durability::ASYNC;      // When a replicated write is acknowledged
+    size_t virtual_nodes = HashRing::DEFAULT_VNODES;  // Must match the clients' ring for MIGRATE layouts
+    // Servers to join through; any non-empty list enables gossip membership
+    std::vector<sockaddr_in> seeds{};
+    std::string advertise{};  // "ip:port" peers and clients reach this server at; defaults to loopback
+    // Term of the leases granted on reads of hot keys that ask for one (see Client::set_near_cache),
+    // which bounds how stale a cached value can be; 0 grants none
+    uint32_t lease_ms = 50;
+    // Requests per second past which this server copies a hot key it holds to every live member, so
+    // clients can read it anywhere. Needs gossip to know the members; 0 copies nothing
+    uint64_t spread_rate = 5000;
 };
 
 class Storage
 {
-    using HashTable = gtl::parallel_flat_hash_map_m<std::string, std::string>;
-    HashTable table;
+    // Re-exports the submap index so multi-key batches can be grouped per submap lock
+    template <typename Map>
+    struct SubmapTable : Map
+    {
+        using Map::subidx;
+    };
+    using HashTable = SubmapTable<gtl::parallel_flat_hash_map_m<std::string, StoredValue>>;
+    // The same table without locks, for a shard that is the only thread ever touching it
+    using ShardTable = SubmapTable<gtl::parallel_flat_hash_map<std::string, StoredValue>>;
+    HashTable table;  // Unused while keys are steered to shards
+
+    // SHARDED engine with keys steered to their shard's socket (attach_key_steering): each shard keeps
+    // the keys it owns in a private table. Any other thread that needs one of them hands the owner a job
+    // and waits for it (on_shards), waking it with a datagram the filter steers to its socket.
+    struct Shard
+    {
+        ShardTable table;
+        moodycamel::ConcurrentQueue<std::function<void()>> jobs;
+        int fd = -1;
+    };
+    std::vector<std::unique_ptr<Shard>> shards;  // Empty unless keys are steered
+    std::atomic<size_t> shard_waiters{0};        // Threads waiting on jobs; shards keep serving them until 0
+    std::atomic<uint64_t> handoff_count{0};
 
     moodycamel::ConcurrentQueue<TaskEntry> task_queue;
     moodycamel::ConcurrentQueue<ResponseEntry> response_queue;
     
-    std::array<std::thread, 5> workers;
-    uint16_t port;
-    int server_fd = 0;
+    std::vector<std::thread> workers;
+    StorageConfig config;
+    std::vector<int> server_fds;
+
+    IdleWaiter task_waiter;
+    IdleWaiter response_waiter;
+
+    // Only set when replicas are configured; outlives run() so its counters stay readable
+    std::unique_ptr<Replicator> replicator;
+
+    // A cluster layout handed over by MIGRATE. Layouts are kept until the server exits, so an
+    // executor may keep using one it loaded after a newer one has been published.
+    struct Membership
+    {
+        HashRing ring;
+        std::vector<std::string> names;  // "ip:port", indexed by ring node id
+        std::string layout;              // names joined by '|', to recognise a repeated MIGRATE
+        uint32_t self = 0;
+        std::vector<std::unique_ptr<Replicator>> forwarders;  // Per node, null for self
+
+        explicit Membership(size_t vnodes) : ring(vnodes) {}
+        uint32_t owner(std::string_view key) const { return ring.owner(key); }
+    };
+    std::mutex migration_mutex;  // Serializes MIGRATE requests
+    std::vector<std::unique_ptr<Membership>> memberships;
+    std::atomic<const Membership*> current_membership{nullptr};  // Keys it gives away are answered MOVED
+    std::atomic<const Membership*> target_membership{nullptr};   // Writes it gives away are forwarded
+    bool migrating = false;       // Guarded by migration_mutex
+    bool migration_failed = false;
+    std::thread migration_thread;
+
+    // Only set when seeds are configured; like the replicator it outlives run()
+    std::unique_ptr<Gossip> gossip;
+    std::string self_name;  // As gossip knows this server
 
     // Shutdown flag
     std::atomic<bool> running{false};
+    // Falls back to SOCKETS if any thread could not set up io_uring
+    std::atomic<IoBackend> active_backend{IoBackend::SOCKETS};
     
     // Performance counters
     std::atomic<uint64_t> received_count{0};
     std::atomic<uint64_t> executed_count{0};
     std::atomic<uint64_t> responded_count{0};
+    std::atomic<uint64_t> send_batch_count{0};
+    std::atomic<uint64_t> migrated_keys{0};
+    std::atomic<uint64_t> migration_ms{0};
+    std::atomic<uint64_t> moved_count{0};
+
+    // One set per worker thread, registered when it starts, so recording never contends; merged on
+    // demand. Kept after run() so the totals stay readable.
+    using StageHistograms = std::array<LatencyHistogram, NUM_STAGES>;
+    mutable std::mutex latency_mutex;
+    std::vector<std::unique_ptr<StageHistograms>> latencies;
+
+    // Hot keys: every request thread samples the keys it serves, and hot_key_thread merges the
+    // samplers once per interval and publishes a new HotKeySet. Threads keep their own reference to
+    // the published set and only take the lock when the epoch moves.
+    static constexpr uint64_t HOT_KEY_INTERVAL_NS = 1'000'000'000;
+    static constexpr size_t HOT_KEY_TOP = 16;
+    static constexpr uint64_t HOT_KEY_SHARE = 100;        // Hinted once it takes 1/HOT_KEY_SHARE of the sample
+    static constexpr uint64_t HOT_KEY_MIN_SAMPLES = 256;  // Below this the shares mean nothing
+    struct HotKeyView
+    {
+        HotKeySampler* sampler = nullptr;
+        std::shared_ptr<const HotKeySet> set{};
+        uint64_t epoch = 0;
+        std::shared_ptr<const HotKeyCopies> copies{};
+        uint64_t copies_epoch = 0;
+    };
+    mutable std::mutex hot_key_mutex;
+    std::vector<std::unique_ptr<HotKeySampler>> hot_key_samplers;
+    std::shared_ptr<const HotKeySet> hot_keys;  // Guarded by hot_key_mutex
+    std::atomic<uint64_t> hot_key_epoch{0};
+    std::atomic<uint64_t> hot_key_hints{0};
+    std::thread hot_key_thread;
+
+    // When a key hashing to each slot was last written. Lossy: a collision only refuses a lease
+    static constexpr size_t LEASE_SLOTS = 4096;
+    std::array<std::atomic<uint64_t>, LEASE_SLOTS> write_stamps{};
+    std::atomic<uint64_t> leases_granted{0};
+    std::atomic<uint64_t> leases_refused{0};
+
+    // Copies of other servers' hot keys, replaced wholesale by each COPY and read through HotKeyView.
+    // Copies outlive a few pushes, so one lost COPY does not send readers back to the owner.
+    static constexpr uint64_t COPY_LIFETIME_NS = 3 * HOT_KEY_INTERVAL_NS;
+    std::mutex copy_mutex;
+    std::shared_ptr<const HotKeyCopies> hot_copies;  // Guarded by copy_mutex
+    std::atomic<uint64_t> copy_epoch{0};
+    // Writes to copied keys, queued by the request threads for hot_key_thread to push to the copies
+    moodycamel::ConcurrentQueue<std::pair<std::string, std::string>> copy_writes;
+    std::atomic<uint64_t> copies_pushed{0};
+    std::atomic<uint64_t> copy_reads{0};
 
-    int create_server(int& server_fd) const;
+    StageHistograms& register_latencies();
+    size_t shard_of(std::string_view key) const { return steer_hash(key) % shards.size(); }
+    // Runs f(table, shard) for each target shard on its own thread, all at once, and waits for them;
+    // false if the server stopped first
+    template <typename F> bool on_shards(std::span<const size_t> targets, F&& f);
+    // f(table) on the table holding key / f(table, index) on every table, as seen by its owner
+    template <typename F> bool with_key_table(std::string_view key, F&& f);
+    template <typename F> bool with_tables(F&& f);
+    void run_shard_jobs(Shard& shard);
+    void wake_shard(size_t shard) const;
+    HotKeyView register_hot_keys();
+    // Samples the task's key, notes its writes for leasing, and flags a successful read of a hot key
+    // in its binary response, granting a lease if asked
+    void track_key(HotKeyView& view, const TaskEntry& task, const std::vector<LogEntry>& writes, uint64_t now_ns,
+                   std::string& response);
+    void maintain_hot_keys();
+    void refresh_hot_keys();
+    void push_copies(const std::vector<sockaddr_in>& peers, const std::vector<std::pair<std::string, std::string>>& entries);
+    std::string apply_copies(const TaskEntry& task);
+    int create_server(int& server_fd, bool reuse_port) const;
+    void close_servers();
     void receive(int server_fd);
+    template <typename Receiver> void receive_from(Receiver& receiver);
     void execute();
+    std::string execute_task(const TaskEntry& task, std::vector<LogEntry>& writes);
+    template <typename Table> std::string execute_key(Table& target, const TaskEntry& task, std::vector<LogEntry>& writes);
+    std::string execute_multi(const TaskEntry& task, std::vector<LogEntry>& writes);
+    bool ship_writes(std::vector<LogEntry>& writes, const sockaddr_in& client_addr, std::string& response);
+    bool holds_replies() const { return replicator && replicator->holds_replies(); }
+    std::string start_migration(const TaskEntry& task);
+    std::string list_members(const TaskEntry& task) const;
+    std::string collect_stats(bool prometheus);
+    void migrate(const Membership* next);
+    bool drain_forwarders(const Membership& membership, uint64_t limit) const;
+    void forward_writes(const std::vector<LogEntry>& writes) const;
+    static std::string format_response(const TaskEntry& task, protocol::Status status, std::string value,
+                                       uint64_t version = 0);
+    void serve_shard(int server_fd, size_t shard);
+    template <typename Receiver, typename Sender> void serve_shard_with(Receiver& receiver, Sender& sender);
     void respond(int server_fd);
-    static int parse_req(const std::string& input, Request& req,
-                         std::string& key, std::optional<std::string>& value);
+    template <typename Sender> void respond_with(Sender& sender);
+    static int parse_req(std::string_view input, TaskEntry& task);
+    static int parse_binary_req(std::string_view input, TaskEntry& task);
+    static int parse_text_req(std::string_view input, Request& req,
+                              std::string& key, std::optional<std::string>& value);
 
 public:
     explicit Storage(uint16_t port = 1895);
+    explicit Storage(const StorageConfig& config);
     ~Storage();
     
     void run();
@@ -68,6 +271,29 @@ public:
     uint64_t get_received_count() const { return received_count.load(); }
     uint64_t get_executed_count() const { return executed_count.load(); }
     uint64_t get_responded_count() const { return responded_count.load(); }
+    uint64_t get_send_batch_count() const { return send_batch_count.load(); }
+    IoBackend get_io_backend() const { return active_backend.load(); }
+    uint64_t get_replicated_batches() const { return replicator ? replicator->get_shipped_batches() : 0; }
+    uint64_t get_replicated_writes() const { return replicator ? replicator->get_shipped_writes() : 0; }
+    uint64_t get_failed_replications() const { return replicator ? replicator->get_failed_batches() : 0; }
+    uint64_t get_migrated_keys() const { return migrated_keys.load(); }
+    uint64_t get_migration_ms() const { return migration_ms.load(); }
+    uint64_t get_moved_count() const { return moved_count.load(); }
+    // SHARDED with a private table per shard; handoffs count requests executed by another shard
+    bool is_steered() const { return !shards.empty(); }
+    uint64_t get_handoff_count() const { return handoff_count.load(); }
+    // Safe to call while running; percentiles cover everything since startup
+    LatencyHistogram::Summary get_stage_latency(Stage stage) const;
+    // The hottest keys as of the last refresh, or null before the first one
+    std::shared_ptr<const HotKeySet> get_hot_keys() const;
+    uint64_t get_hot_key_hints() const { return hot_key_hints.load(); }
+    uint64_t get_leases_granted() const { return leases_granted.load(); }
+    uint64_t get_leases_refused() const { return leases_refused.load(); }
+    uint64_t get_copies_pushed() const { return copies_pushed.load(); }
+    uint64_t get_copy_reads() const { return copy_reads.load(); }
+    bool has_gossip() const { return gossip != nullptr; }
+    uint64_t get_suspected_count() const { return gossip ? gossip->get_suspected_count() : 0; }
+    uint64_t get_dead_count() const { return gossip ? gossip->get_dead_count() : 0; }
 };
 
 #endif //DISTIBUTED_HASH_TABLE_STORAGE_H
\ No newline at end of file
@@ -16,8 +16,17 @@ TEST_DURATION=20
 BINARY_PATH="./build/Distibuted_Hash_Table"
 CSV_OUTPUT="benchmark_results.csv"
 
-# Test combinations as specified
-SERVER_COUNTS=(1 2 3)
+# Test combinations (SERVER_COUNTS="1 2 4 8 16" ./benchmark_test.sh overrides the sweep)
+SERVER_COUNTS=(${SERVER_COUNTS:-1 2 3 4 6 8})
+
+# Replication levels to compare: none, async (ack after local apply) or sync (ack after backup ack).
+# With replication every primary on PORT_BASE+i ships its writes to a backup on BACKUP_PORT_BASE+i.
+# chain runs CHAIN_LENGTH nodes per shard: writes enter at the head (PORT_BASE+i), flow through
+# BACKUP_PORT_BASE+100*j+i, and reads are served by the last one.
+# DURABILITY_LEVELS="none async sync chain" ./benchmark_test.sh measures the cost of each level
+DURABILITY_LEVELS=(${DURABILITY_LEVELS:-none})
+BACKUP_PORT_BASE=2895
+CHAIN_LENGTH=${CHAIN_LENGTH:-3}
 CLIENT_THREADS=(50 100 150 200 250 300)
 
 # Colors for output
@@ -83,24 +92,68 @@ check_binary() {
     fi
 }
 
+# Port of node j (0 = head) in chain i
+chain_port() {
+    if [ $2 -eq 0 ]; then
+        echo $((PORT_BASE + $1))
+    else
+        echo $((BACKUP_PORT_BASE + 100 * ($2 - 1) + $1))
+    fi
+}
+
 start_servers() {
     local num_servers=$1
+    local durability=$2
     SERVER_PIDS=()
 
+    # Primaries take SERVER_PIDS[0..n-1]; backups, if any, follow them
     for ((i=0; i<num_servers; i++)); do
         local port=$((PORT_BASE + i))
-        $BINARY_PATH $port > /tmp/dht_server_${i}.log 2>&1 &
+        if [ "$durability" == "none" ] || { [ "$durability" == "chain" ] && [ $CHAIN_LENGTH -lt 2 ]; }; then
+            $BINARY_PATH $port > /tmp/dht_server_${i}.log 2>&1 &
+        elif [ "$durability" == "chain" ]; then
+            CHAIN_NEXT="127.0.0.1:$(chain_port $i 1)" $BINARY_PATH $port > /tmp/dht_server_${i}.log 2>&1 &
+        else
+            REPLICAS="127.0.0.1:$((BACKUP_PORT_BASE + i))" DURABILITY=$durability \
+                $BINARY_PATH $port > /tmp/dht_server_${i}.log 2>&1 &
+        fi
         SERVER_PIDS+=($!)
     done
 
+    if [ "$durability" == "chain" ]; then
+        # Backup logs are numbered by position in SERVER_PIDS, past the heads
+        local index=0
+        for ((j=1; j<CHAIN_LENGTH; j++)); do
+            for ((i=0; i<num_servers; i++)); do
+                if [ $((j + 1)) -lt $CHAIN_LENGTH ]; then
+                    CHAIN_NEXT="127.0.0.1:$(chain_port $i $((j + 1)))" \
+                        $BINARY_PATH $(chain_port $i $j) > /tmp/dht_backup_${index}.log 2>&1 &
+                else
+                    $BINARY_PATH $(chain_port $i $j) > /tmp/dht_backup_${index}.log 2>&1 &
+                fi
+                SERVER_PIDS+=($!)
+                ((index++))
+            done
+        done
+    elif [ "$durability" != "none" ]; then
+        for ((i=0; i<num_servers; i++)); do
+            $BINARY_PATH $((BACKUP_PORT_BASE + i)) > /tmp/dht_backup_${i}.log 2>&1 &
+            SERVER_PIDS+=($!)
+        done
+    fi
+
     # Wait for servers to initialize
     sleep 2
 
     # Verify all servers are running
-    for ((i=0; i<num_servers; i++)); do
+    for ((i=0; i<${#SERVER_PIDS[@]}; i++)); do
         if ! kill -0 ${SERVER_PIDS[$i]} 2>/dev/null; then
             log_error "Server $i failed to start!"
-            cat /tmp/dht_server_${i}.log
+            if [ $i -lt $num_servers ]; then
+                cat /tmp/dht_server_${i}.log
+            else
+                cat /tmp/dht_backup_$((i - num_servers)).log
+            fi
             return 1
         fi
     done
@@ -109,22 +162,16 @@ start_servers() {
 }
 
 stop_servers() {
-    local num_servers=$1
-
-    for ((i=0; i<num_servers; i++)); do
-        if [ -n "${SERVER_PIDS[$i]}" ]; then
-            kill -TERM ${SERVER_PIDS[$i]} 2>/dev/null || true
-        fi
+    for pid in "${SERVER_PIDS[@]}"; do
+        kill -TERM $pid 2>/dev/null || true
     done
 
     # Wait for graceful shutdown
     sleep 2
 
     # Force kill if still running
-    for ((i=0; i<num_servers; i++)); do
-        if [ -n "${SERVER_PIDS[$i]}" ]; then
-            kill -9 ${SERVER_PIDS[$i]} 2>/dev/null || true
-        fi
+    for pid in "${SERVER_PIDS[@]}"; do
+        kill -9 $pid 2>/dev/null || true
     done
 
     SERVER_PIDS=()
@@ -133,10 +180,11 @@ stop_servers() {
 run_test() {
     local num_servers=$1
     local num_clients=$2
+    local durability=$3
 
     echo ""
     echo -e "${CYAN}=============================================================================${NC}"
-    echo -e "${CYAN}  TEST: $num_servers server(s), $num_clients client threads, ${TEST_DURATION}s${NC}"
+    echo -e "${CYAN}  TEST: $num_servers server(s), $num_clients client threads, replication: $durability, ${TEST_DURATION}s${NC}"
     echo -e "${CYAN}=============================================================================${NC}"
 
     # Clean up any previous processes
@@ -145,35 +193,51 @@ run_test() {
 
     # Start servers
     log_info "Starting $num_servers server(s)..."
-    if ! start_servers $num_servers; then
+    if ! start_servers $num_servers $durability; then
         log_error "Failed to start servers"
         # Write error row to CSV
-        echo "$num_servers,$num_clients,ERROR,ERROR,ERROR,ERROR" >> "$CSV_OUTPUT"
+        echo "$num_servers,$num_clients,$durability,ERROR,ERROR,ERROR,ERROR" >> "$CSV_OUTPUT"
         return 1
     fi
     log_success "All servers running"
 
-    # Build SERVER_IPS string
+    # Build SERVER_IPS string; every local server listens on its own port
     local server_ips=""
     for ((i=0; i<num_servers; i++)); do
         local port=$((PORT_BASE + i))
         if [ -n "$server_ips" ]; then
             server_ips="${server_ips}|"
         fi
-        server_ips="${server_ips}127.0.0.1"
+        server_ips="${server_ips}127.0.0.1:${port}"
     done
 
+    # Chain reads go to the tails, listed in the same order as the heads
+    local read_ips=""
+    if [ "$durability" == "chain" ]; then
+        for ((i=0; i<num_servers; i++)); do
+            if [ -n "$read_ips" ]; then
+                read_ips="${read_ips}|"
+            fi
+            read_ips="${read_ips}127.0.0.1:$(chain_port $i $((CHAIN_LENGTH - 1)))"
+        done
+    fi
+
     # Start client
     log_info "Starting client with $num_clients threads..."
-    SERVER_IPS="$server_ips" NUM_CLIENTS=$num_clients $BINARY_PATH $PORT_BASE > /tmp/dht_client.log 2>&1 &
+    if [ -n "$read_ips" ]; then
+        SERVER_IPS="$server_ips" READ_IPS="$read_ips" NUM_CLIENTS=$num_clients \
+            $BINARY_PATH $PORT_BASE > /tmp/dht_client.log 2>&1 &
+    else
+        SERVER_IPS="$server_ips" NUM_CLIENTS=$num_clients $BINARY_PATH $PORT_BASE > /tmp/dht_client.log 2>&1 &
+    fi
     local client_pid=$!
 
     if ! kill -0 $client_pid 2>/dev/null; then
         log_error "Client failed to start!"
         cat /tmp/dht_client.log
-        stop_servers $num_servers
+        stop_servers
         # Write error row to CSV
-        echo "$num_servers,$num_clients,ERROR,ERROR,ERROR,ERROR" >> "$CSV_OUTPUT"
+        echo "$num_servers,$num_clients,$durability,ERROR,ERROR,ERROR,ERROR" >> "$CSV_OUTPUT"
         return 1
     fi
 
@@ -205,7 +269,7 @@ run_test() {
 
     # Stop servers
     log_info "Stopping servers..."
-    stop_servers $num_servers
+    stop_servers
 
     # Extract results
     echo ""
@@ -242,7 +306,7 @@ run_test() {
     fi
 
     # Write to CSV
-    echo "$num_servers,$num_clients,$total_ops,$timeouts,$throughput,$avg_latency_ms" >> "$CSV_OUTPUT"
+    echo "$num_servers,$num_clients,$durability,$total_ops,$timeouts,$throughput,$avg_latency_ms" >> "$CSV_OUTPUT"
 
     echo ""
     echo -e "${GREEN}Calculated Average Latency: ${avg_latency_ms} ms${NC}"
@@ -285,7 +349,8 @@ main() {
     echo "  - Server counts: ${SERVER_COUNTS[*]}"
     echo "  - Client thread counts: ${CLIENT_THREADS[*]}"
     echo "  - Test duration: ${TEST_DURATION} seconds per test"
-    echo "  - Total tests: $((${#SERVER_COUNTS[@]} * ${#CLIENT_THREADS[@]}))"
+    echo "  - Replication: ${DURABILITY_LEVELS[*]}"
+    echo "  - Total tests: $((${#SERVER_COUNTS[@]} * ${#CLIENT_THREADS[@]} * ${#DURABILITY_LEVELS[@]}))"
     echo "  - Output file: $CSV_OUTPUT"
     echo ""
 
@@ -296,13 +361,15 @@ main() {
     cleanup
 
     # Initialize CSV file with header
-    echo "servers,clients,total_ops,timeouts,throughput_ops_sec,avg_latency_ms" > "$CSV_OUTPUT"
+    echo "servers,clients,durability,total_ops,timeouts,throughput_ops_sec,avg_latency_ms" > "$CSV_OUTPUT"
     log_info "Created CSV file: $CSV_OUTPUT"
 
     # Run all test combinations
-    for num_servers in "${SERVER_COUNTS[@]}"; do
-        for num_clients in "${CLIENT_THREADS[@]}"; do
-            run_test $num_servers $num_clients
+    for durability in "${DURABILITY_LEVELS[@]}"; do
+        for num_servers in "${SERVER_COUNTS[@]}"; do
+            for num_clients in "${CLIENT_THREADS[@]}"; do
+                run_test $num_servers $num_clients $durability
+            done
         done
     done
 
@@ -7,7 +7,7 @@
 # 1. SSH's into remote machines and selects the least-used ones for servers
 # 2. Starts servers on remote machines
 # 3. Runs clients LOCALLY on this machine
-# 4. Tests all combinations of servers (1,2,3) and clients (50,100,150,200,250,300)
+# 4. Tests all combinations of SERVER_COUNTS and CLIENT_THREADS
 # 5. Records results to CSV with throughput and calculated latency
 # =============================================================================
 
@@ -31,11 +31,12 @@ REMOTE_BINARY_PATH="/home/lgd226/CSE376/Distributed-Hash-Table/build/Distibuted_
 CSV_OUTPUT="distributed_benchmark_results.csv"
 
 # Test combinations (reduced for faster iteration)
-SERVER_COUNTS=(1 2 3)
+# SERVER_COUNTS="1 2 4 8" ./distributed_benchmark.sh overrides the server sweep
+SERVER_COUNTS=(${SERVER_COUNTS:-1 2 3 4 6 8})
 CLIENT_THREADS=(500 1000)
 
-# Maximum servers to select (we'll pick the 3 best machines)
-MAX_SERVERS=3
+# Machines to select: enough for the largest server count in the sweep
+MAX_SERVERS=$(printf '%s\n' "${SERVER_COUNTS[@]}" | sort -n | tail -n 1)
 
 # Available machines
 MACHINES=(
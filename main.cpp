@@ -1,20 +1,25 @@
+#include "./AsyncClient.h"
 #include "./Client.h"
 #include "./Storage.h"
 #include <arpa/inet.h>
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <cstdlib>
 #include <csignal>
+#include <cstdio>
 #include <iostream>
 #include <sstream>
+#include <unistd.h>
 #include <vector>
 
 // Configurable number of clients per machine (can be overridden by NUM_CLIENTS env var)
 constexpr size_t DEFAULT_NUM_CLIENTS = 50;
+// Requests kept in flight per server socket by each async client (WINDOW env var)
+constexpr size_t DEFAULT_ASYNC_WINDOW = 32;
 
-// Global pointers for signal handling
+// Global pointers for signal handling; clients are stopped by the main thread once it sees the flag
 static Storage* g_storage = nullptr;
-static std::vector<Client*> g_clients;
 static std::atomic<bool> g_shutdown_requested{false};
 
 void signal_handler(int signal)
@@ -22,13 +27,6 @@ void signal_handler(int signal)
     if (signal == SIGINT || signal == SIGTERM)
     {
         g_shutdown_requested.store(true);
-        for (auto* client : g_clients)
-        {
-            if (client != nullptr)
-            {
-                client->stop();
-            }
-        }
         if (g_storage != nullptr)
         {
             g_storage->stop();
@@ -41,7 +39,8 @@ void run_storage(Storage& storage)
     storage.run();
 }
 
-void run_client(Client& client)
+template <typename ClientType>
+void run_client(ClientType& client)
 {
     client.run();
 }
@@ -64,16 +63,42 @@ std::vector<std::string> parse_server_ips(const char* env_value)
     return ips;
 }
 
-int run_server_mode(uint16_t port)
+void print_stage_latencies(const Storage& storage)
+{
+    constexpr std::array<std::pair<Stage, const char*>, NUM_STAGES> stages{{
+        {Stage::RECEIVE, "receive"}, {Stage::QUEUE, "queue"}, {Stage::EXECUTE, "execute"}, {Stage::RESPOND, "respond"}}};
+    
+    std::cout << "Stage latency (us):     count      p50      p90      p99    p99.9      max" << std::endl;
+    for (const auto& [stage, name] : stages)
+    {
+        const LatencyHistogram::Summary summary = storage.get_stage_latency(stage);
+        if (summary.count == 0)
+        {
+            continue;
+        }
+        std::printf("  %-8s %18llu %8.1f %8.1f %8.1f %8.1f %8.1f\n", name, static_cast<unsigned long long>(summary.count),
+                    summary.p50 / 1e3, summary.p90 / 1e3, summary.p99 / 1e3, summary.p999 / 1e3, summary.max / 1e3);
+    }
+    std::fflush(stdout);
+}
+
+int run_server_mode(const StorageConfig& config, const unsigned stats_interval)
 {    
-    Storage storage(port);
+    Storage storage(config);
     g_storage = &storage;
     
     std::thread storage_thread(run_storage, std::ref(storage));
     
+    // STATS_INTERVAL prints the running per-stage percentiles every that many seconds
+    auto next_stats = std::chrono::steady_clock::now() + std::chrono::seconds(stats_interval);
     while (!g_shutdown_requested.load())
     {
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (stats_interval > 0 && std::chrono::steady_clock::now() >= next_stats)
+        {
+            next_stats += std::chrono::seconds(stats_interval);
+            print_stage_latencies(storage);
+        }
     }
     
     storage.stop();
@@ -84,55 +109,101 @@ int run_server_mode(uint16_t port)
     }
     
     std::cout << "\nServer-side metrics:" << std::endl;
+    std::cout << "I/O backend: " << (storage.get_io_backend() == IoBackend::IO_URING ? "io_uring" : "sockets") << std::endl;
     std::cout << "Received: " << storage.get_received_count() << std::endl;
     std::cout << "Executed: " << storage.get_executed_count() << std::endl;
     std::cout << "Responded: " << storage.get_responded_count() << std::endl;
     
-    g_storage = nullptr;
-    return 0;
-}
-
-int run_client_mode(uint16_t port, const std::vector<std::string>& server_ips, size_t num_clients)
-{    
-    std::array<sockaddr_in, 3> server_addrs{};
+    if (storage.get_send_batch_count() > 0)
+    {
+        const double avg_send_batch = static_cast<double>(storage.get_responded_count()) /
+                                      static_cast<double>(storage.get_send_batch_count());
+        std::cout << "Avg send batch: " << avg_send_batch << std::endl;
+    }
     
-    for (size_t i = 0; i < std::min(server_ips.size(), static_cast<size_t>(3)); ++i)
+    if (storage.get_replicated_batches() > 0)
     {
-        server_addrs[i].sin_family = AF_INET;
-        server_addrs[i].sin_port = htons(port);
-        
-        if (inet_pton(AF_INET, server_ips[i].c_str(), &server_addrs[i].sin_addr) <= 0)
-        {
-            std::cerr << "Invalid server IP address: " << server_ips[i] << std::endl;
-            return 1;
-        }
-        
+        std::cout << "Replicated writes: " << storage.get_replicated_writes() << std::endl;
+        std::cout << "Replication batches: " << storage.get_replicated_batches()
+                  << " (failed: " << storage.get_failed_replications() << ")" << std::endl;
+        std::cout << "Avg writes per batch: " << static_cast<double>(storage.get_replicated_writes()) /
+                                                 static_cast<double>(storage.get_replicated_batches()) << std::endl;
     }
     
-    std::vector<std::unique_ptr<Client>> clients;
-    std::vector<std::thread> client_threads;
+    if (storage.is_steered())
+    {
+        std::cout << "Shard handoffs: " << storage.get_handoff_count() << std::endl;
+    }
     
-    clients.reserve(num_clients);
-    client_threads.reserve(num_clients);
-    g_clients.reserve(num_clients);
+    if (storage.get_migrated_keys() > 0 || storage.get_moved_count() > 0)
+    {
+        std::cout << "Migrated keys: " << storage.get_migrated_keys() << " (" << storage.get_migration_ms() << " ms)" << std::endl;
+        std::cout << "Redirected (MOVED): " << storage.get_moved_count() << std::endl;
+    }
     
-    for (size_t i = 0; i < num_clients; ++i)
+    if (storage.has_gossip())
     {
-        auto client = std::make_unique<Client>(server_addrs, server_ips.size(), 0);
-        g_clients.push_back(client.get());
-        clients.push_back(std::move(client));
+        std::cout << "Members suspected: " << storage.get_suspected_count()
+                  << " (declared dead: " << storage.get_dead_count() << ")" << std::endl;
     }
     
+    if (storage.get_hot_key_hints() > 0)
+    {
+        std::cout << "Hot key hints sent: " << storage.get_hot_key_hints() << std::endl;
+    }
+    if (storage.get_leases_granted() > 0 || storage.get_leases_refused() > 0)
+    {
+        std::cout << "Leases granted: " << storage.get_leases_granted()
+                  << " (refused after writes: " << storage.get_leases_refused() << ")" << std::endl;
+    }
+    if (storage.get_copies_pushed() > 0 || storage.get_copy_reads() > 0)
+    {
+        std::cout << "Hot key copies pushed: " << storage.get_copies_pushed()
+                  << " (reads served from copies: " << storage.get_copy_reads() << ")" << std::endl;
+    }
+    
+    print_stage_latencies(storage);
+    
+    g_storage = nullptr;
+    return 0;
+}
+
+template <typename ClientType>
+int drive_clients(std::vector<std::unique_ptr<ClientType>>& clients, const unsigned report_interval)
+{
+    const size_t num_clients = clients.size();
+    std::vector<std::thread> client_threads;
+    client_threads.reserve(num_clients);
+    
     const auto start_time = std::chrono::steady_clock::now();
     
     for (size_t i = 0; i < num_clients; ++i)
     {
-        client_threads.emplace_back(run_client, std::ref(*clients[i]));
+        client_threads.emplace_back(run_client<ClientType>, std::ref(*clients[i]));
     }
     
+    // With REPORT_INTERVAL set, throughput is sampled as the run goes, e.g. to watch a live migration
+    auto last_report = start_time;
+    uint64_t last_ops = 0;
     while (!g_shutdown_requested.load())
     {
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        
+        const auto now = std::chrono::steady_clock::now();
+        if (report_interval == 0 || now - last_report < std::chrono::seconds(report_interval))
+        {
+            continue;
+        }
+        uint64_t ops = 0;
+        for (const auto& client : clients)
+        {
+            ops += client->get_successful_ops();
+        }
+        const double seconds = std::chrono::duration<double>(now - last_report).count();
+        std::cout << "[" << std::chrono::duration_cast<std::chrono::seconds>(now - start_time).count() << "s] "
+                  << static_cast<uint64_t>(static_cast<double>(ops - last_ops) / seconds) << " ops/sec" << std::endl;
+        last_report = now;
+        last_ops = ops;
     }
     
     const auto end_time = std::chrono::steady_clock::now();
@@ -153,6 +224,19 @@ int run_client_mode(uint16_t port, const std::vector<std::string>& server_ips, s
     
     uint64_t total_ops = 0;
     uint64_t total_timeouts = 0;
+    uint64_t total_stale = 0;
+    uint64_t total_latency_ns = 0;
+    uint64_t total_repairs = 0;
+    uint64_t total_membership_changes = 0;
+    uint64_t total_hedges = 0;
+    uint64_t total_hedge_wins = 0;
+    uint64_t total_hot_hints = 0;
+    uint64_t total_cache_hits = 0;
+    uint64_t total_spread_reads = 0;
+    uint64_t total_unavailable = 0;
+    uint64_t total_not_stored = 0;
+    uint64_t total_redirects = 0;
+    uint64_t total_errors = 0;
     
     for (size_t i = 0; i < num_clients; ++i)
     {
@@ -160,19 +244,314 @@ int run_client_mode(uint16_t port, const std::vector<std::string>& server_ips, s
         uint64_t timeouts = clients[i]->get_timeout_count();
         total_ops += ops;
         total_timeouts += timeouts;
+        total_stale += clients[i]->get_stale_count();
+        if constexpr (requires { clients[i]->get_total_latency_ns(); })
+        {
+            total_latency_ns += clients[i]->get_total_latency_ns();
+        }
+        if constexpr (requires { clients[i]->get_unavailable_count(); })
+        {
+            total_unavailable += clients[i]->get_unavailable_count();
+        }
+        if constexpr (requires { clients[i]->get_read_repairs(); })
+        {
+            total_repairs += clients[i]->get_read_repairs();
+        }
+        if constexpr (requires { clients[i]->get_membership_changes(); })
+        {
+            total_membership_changes += clients[i]->get_membership_changes();
+        }
+        if constexpr (requires { clients[i]->get_hedged_reads(); })
+        {
+            total_hedges += clients[i]->get_hedged_reads();
+            total_hedge_wins += clients[i]->get_hedge_wins();
+        }
+        if constexpr (requires { clients[i]->get_hot_hints(); })
+        {
+            total_hot_hints += clients[i]->get_hot_hints();
+            total_cache_hits += clients[i]->get_cache_hits();
+            total_spread_reads += clients[i]->get_spread_reads();
+        }
+        total_not_stored += clients[i]->get_not_stored_count();
+        total_errors += clients[i]->get_error_count();
+        if constexpr (requires { clients[i]->get_redirect_count(); })
+        {
+            total_redirects += clients[i]->get_redirect_count();
+        }
     }
     
     std::cout << "\nCLIENT RESULTS" << std::endl;
     std::cout << "Total clients: " << num_clients << std::endl;
     std::cout << "Run duration: " << run_duration.count() << " seconds" << std::endl;
     std::cout << "Total successful operations: " << total_ops << std::endl;
+    std::cout << "Total timeouts: " << total_timeouts << std::endl;
+    std::cout << "Stale responses discarded: " << total_stale << std::endl;
+    if (total_unavailable > 0)
+    {
+        std::cout << "Unavailable (too few live owners): " << total_unavailable << std::endl;
+    }
+    if (total_not_stored > 0)
+    {
+        std::cout << "Not stored (key existed): " << total_not_stored << std::endl;
+    }
+    if (total_redirects > 0)
+    {
+        std::cout << "Redirected (MOVED): " << total_redirects << std::endl;
+    }
+    if (total_errors > 0)
+    {
+        std::cout << "Error replies: " << total_errors << std::endl;
+    }
+    if (total_repairs > 0)
+    {
+        std::cout << "Read repairs: " << total_repairs << std::endl;
+    }
+    if (total_membership_changes > 0)
+    {
+        std::cout << "Membership changes applied: " << total_membership_changes << std::endl;
+    }
+    if (total_hedges > 0)
+    {
+        std::cout << "Hedged reads: " << total_hedges << " (answered first: " << total_hedge_wins << ")" << std::endl;
+    }
+    if (total_hot_hints > 0)
+    {
+        std::cout << "Hot key hints: " << total_hot_hints << std::endl;
+    }
+    if (total_cache_hits > 0)
+    {
+        std::cout << "Near cache hits: " << total_cache_hits << std::endl;
+    }
+    if (total_spread_reads > 0)
+    {
+        std::cout << "Hot key reads sent to copies: " << total_spread_reads << std::endl;
+    }
     
     if (run_duration.count() > 0)
     {
         std::cout << "Throughput: " << (total_ops / run_duration.count()) << " ops/sec" << std::endl;
     }
     
-    g_clients.clear();
+    // Little's law does not apply once a client keeps many requests in flight, so report it directly
+    if (total_latency_ns > 0 && total_ops > 0)
+    {
+        std::cout << "Avg latency: " << (static_cast<double>(total_latency_ns) / total_ops / 1e6) << " ms" << std::endl;
+    }
+    
+    return 0;
+}
+
+int run_client_mode(uint16_t port, const std::vector<std::string>& server_ips, const std::vector<std::string>& read_ips,
+                    size_t num_clients, WireFormat format, bool async_mode, size_t window, size_t virtual_nodes,
+                    const std::array<size_t, 3>& quorum, unsigned report_interval,
+                    std::chrono::milliseconds membership_refresh, double hedge_budget, double key_skew,
+                    size_t near_cache)
+{    
+    // Entries without an explicit port use the one given on the command line
+    std::vector<sockaddr_in> server_addrs(server_ips.size());
+    std::vector<sockaddr_in> read_addrs(read_ips.size());
+    
+    for (size_t i = 0; i < server_ips.size(); ++i)
+    {
+        if (parse_endpoint(server_ips[i], port, server_addrs[i]) == -1)
+        {
+            std::cerr << "Invalid server address: " << server_ips[i] << std::endl;
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < read_ips.size(); ++i)
+    {
+        if (parse_endpoint(read_ips[i], port, read_addrs[i]) == -1)
+        {
+            std::cerr << "Invalid read address: " << read_ips[i] << std::endl;
+            return 1;
+        }
+    }
+    if (!read_addrs.empty() && read_addrs.size() != server_addrs.size())
+    {
+        std::cerr << "READ_IPS must list one tail per entry in SERVER_IPS" << std::endl;
+        return 1;
+    }
+    
+    if (async_mode)
+    {
+        if (!read_addrs.empty() || quorum[0] != 0 || membership_refresh.count() > 0 || hedge_budget > 0 || key_skew > 0 ||
+            near_cache > 0)
+        {
+            std::cerr << "Chain reads, quorums, hedging, membership refresh, key skew and the near cache are not "
+                         "supported with CLIENT_MODE=async" << std::endl;
+            return 1;
+        }
+
+        std::vector<std::unique_ptr<AsyncClient>> clients;
+        clients.reserve(num_clients);
+        for (size_t i = 0; i < num_clients; ++i)
+        {
+            clients.push_back(std::make_unique<AsyncClient>(server_addrs, window, virtual_nodes));
+        }
+        return drive_clients(clients, report_interval);
+    }
+    
+    std::vector<std::unique_ptr<Client>> clients;
+    clients.reserve(num_clients);
+    for (size_t i = 0; i < num_clients; ++i)
+    {
+        clients.push_back(std::make_unique<Client>(server_addrs, 0, format, virtual_nodes));
+        clients.back()->set_key_skew(key_skew);
+        if (!read_addrs.empty())
+        {
+            clients.back()->set_read_servers(read_addrs);
+        }
+        if (quorum[0] != 0 && !clients.back()->set_quorum(quorum[0], quorum[1], quorum[2]))
+        {
+            std::cerr << "Invalid quorum: need 1 <= R,W <= N <= servers and the binary protocol" << std::endl;
+            return 1;
+        }
+        if (hedge_budget > 0 && !clients.back()->set_hedging(hedge_budget))
+        {
+            std::cerr << "Hedging needs a QUORUM with R < N and a budget in (0, 1]" << std::endl;
+            return 1;
+        }
+        if (near_cache > 0 && !clients.back()->set_near_cache(near_cache))
+        {
+            std::cerr << "The near cache needs the binary protocol and no QUORUM or READ_IPS" << std::endl;
+            return 1;
+        }
+        if (membership_refresh.count() > 0 && !clients.back()->set_membership_refresh(membership_refresh))
+        {
+            std::cerr << "Membership refresh needs the binary protocol and no READ_IPS" << std::endl;
+            return 1;
+        }
+    }
+    return drive_clients(clients, report_interval);
+}
+
+// Admin mode: prints one server's STATS report, retrying a few times since it travels over UDP
+int run_stats(const uint16_t port, const std::string& server, const bool prometheus)
+{
+    constexpr int MAX_ATTEMPTS = 5;
+    
+    sockaddr_in addr{};
+    if (parse_endpoint(server, port, addr) == -1)
+    {
+        std::cerr << "Invalid server address: " << server << std::endl;
+        return 1;
+    }
+    
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd == -1)
+    {
+        return 1;
+    }
+    timeval tv{0, 200000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    
+    protocol::Header header;
+    header.opcode = STATS;
+    header.flags = prometheus ? protocol::STATS_PROMETHEUS : 0;
+    header.request_id = 1;
+    std::string request;
+    protocol::encode(request, header, {}, {}, {});
+    
+    std::vector<char> buffer(protocol::MAX_RESPONSE_SIZE);
+    for (int attempt = 0; attempt < MAX_ATTEMPTS; ++attempt)
+    {
+        sendto(fd, request.data(), request.size(), 0, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+        const ssize_t received = recv(fd, buffer.data(), buffer.size(), 0);
+        protocol::Message message;
+        if (received > 0 && protocol::decode(std::string_view(buffer.data(), static_cast<size_t>(received)), message) == 0 &&
+            message.header.opcode == STATS && message.header.status == protocol::OK)
+        {
+            std::cout << message.value << std::flush;
+            close(fd);
+            return 0;
+        }
+    }
+    close(fd);
+    std::cerr << "No STATS reply from " << server << std::endl;
+    return 1;
+}
+
+// Admin mode: asks every member of the new layout to rebalance onto it, then polls until all are done
+int run_rebalance(const uint16_t port, const std::vector<std::string>& members)
+{
+    constexpr auto POLL_INTERVAL = std::chrono::milliseconds(100);
+    constexpr auto TIMEOUT = std::chrono::seconds(60);
+    
+    std::vector<sockaddr_in> addrs(members.size());
+    std::string layout;
+    for (size_t i = 0; i < members.size(); ++i)
+    {
+        if (parse_endpoint(members[i], port, addrs[i]) == -1)
+        {
+            std::cerr << "Invalid member address: " << members[i] << std::endl;
+            return 1;
+        }
+        layout += (i == 0 ? "" : "|") + endpoint_name(addrs[i]);
+    }
+    
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd == -1)
+    {
+        return 1;
+    }
+    timeval tv{0, 20000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<bool> done(members.size(), false);
+    size_t remaining = members.size();
+    std::vector<char> buffer(protocol::MAX_RESPONSE_SIZE);
+    while (remaining > 0 && std::chrono::steady_clock::now() - start < TIMEOUT)
+    {
+        // Repeating MIGRATE is how progress is polled; members answer "migrating" until they finish
+        for (size_t i = 0; i < members.size(); ++i)
+        {
+            if (done[i])
+            {
+                continue;
+            }
+            protocol::Header header;
+            header.opcode = MIGRATE;
+            header.request_id = i + 1;
+            std::string request;
+            protocol::encode(request, header, {}, endpoint_name(addrs[i]), layout);
+            sendto(fd, request.data(), request.size(), 0, reinterpret_cast<const sockaddr*>(&addrs[i]), sizeof(addrs[i]));
+        }
+        
+        const auto round_end = std::chrono::steady_clock::now() + POLL_INTERVAL;
+        while (std::chrono::steady_clock::now() < round_end)
+        {
+            const ssize_t received = recv(fd, buffer.data(), buffer.size(), 0);
+            protocol::Message message;
+            if (received <= 0 || protocol::decode(std::string_view(buffer.data(), received), message) == -1 ||
+                message.header.request_id == 0 || message.header.request_id > members.size())
+            {
+                continue;
+            }
+            const size_t i = message.header.request_id - 1;
+            if (message.header.status == protocol::BAD_REQUEST)
+            {
+                std::cerr << members[i] << " rejected the layout" << std::endl;
+                close(fd);
+                return 1;
+            }
+            if (!done[i] && message.header.status == protocol::OK && message.value == "done")
+            {
+                done[i] = true;
+                --remaining;
+            }
+        }
+    }
+    close(fd);
+    
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    if (remaining > 0)
+    {
+        std::cerr << "Rebalance timed out; " << remaining << " member(s) still migrating" << std::endl;
+        return 1;
+    }
+    std::cout << "Rebalanced onto " << members.size() << " servers in " << elapsed.count() << " ms" << std::endl;
     return 0;
 }
 
@@ -187,11 +566,169 @@ int main(int argc, char** argv)
     std::signal(SIGINT, signal_handler);
     std::signal(SIGTERM, signal_handler);
     
+    // REBALANCE="ip:port|..." lists the complete new layout; every member must already be running
+    const char* rebalance_env = std::getenv("REBALANCE");
+    if (rebalance_env != nullptr && *rebalance_env != '\0')
+    {
+        return run_rebalance(port, parse_server_ips(rebalance_env));
+    }
+    
+    // STATS="ip:port" prints that server's live metrics; STATS_FORMAT=prometheus for a scrape target
+    const char* stats_env = std::getenv("STATS");
+    if (stats_env != nullptr && *stats_env != '\0')
+    {
+        const char* stats_format_env = std::getenv("STATS_FORMAT");
+        return run_stats(port, stats_env, stats_format_env != nullptr && std::string(stats_format_env) == "prometheus");
+    }
+    
     const char* server_ips_env = std::getenv("SERVER_IPS");
     
     if (server_ips_env == nullptr || std::string(server_ips_env).empty())
     {
-        return run_server_mode(port);
+        StorageConfig config;
+        config.port = port;
+        
+        const char* recv_batch_env = std::getenv("RECV_BATCH");
+        if (recv_batch_env != nullptr)
+        {
+            config.recv_batch_size = static_cast<size_t>(std::stoi(recv_batch_env));
+        }
+        
+        const char* recv_threads_env = std::getenv("RECV_THREADS");
+        if (recv_threads_env != nullptr)
+        {
+            config.num_receivers = static_cast<size_t>(std::stoi(recv_threads_env));
+        }
+        
+        const char* exec_threads_env = std::getenv("EXEC_THREADS");
+        if (exec_threads_env != nullptr)
+        {
+            config.num_executors = static_cast<size_t>(std::stoi(exec_threads_env));
+        }
+        
+        const char* engine_env = std::getenv("ENGINE");
+        if (engine_env != nullptr && std::string(engine_env) == "sharded")
+        {
+            config.engine = StorageEngine::SHARDED;
+        }
+        
+        const char* shards_env = std::getenv("SHARDS");
+        if (shards_env != nullptr)
+        {
+            config.num_shards = static_cast<size_t>(std::stoi(shards_env));
+        }
+        
+        const char* io_backend_env = std::getenv("IO_BACKEND");
+        if (io_backend_env != nullptr && std::string(io_backend_env) == "io_uring")
+        {
+            config.io_backend = IoBackend::IO_URING;
+        }
+        
+        const char* wait_policy_env = std::getenv("WAIT_POLICY");
+        if (wait_policy_env != nullptr)
+        {
+            const std::string policy(wait_policy_env);
+            if (policy == "sleep")
+            {
+                config.wait_policy = WaitPolicy::SLEEP;
+            }
+            else if (policy == "spin")
+            {
+                config.wait_policy = WaitPolicy::SPIN;
+            }
+            else if (policy == "blocking")
+            {
+                config.wait_policy = WaitPolicy::BLOCKING;
+            }
+        }
+        
+        // REPLICAS="ip:port|ip:port" makes this node a primary shipping its writes to those backups
+        const char* replicas_env = std::getenv("REPLICAS");
+        if (replicas_env != nullptr)
+        {
+            for (const std::string& replica : parse_server_ips(replicas_env))
+            {
+                sockaddr_in addr{};
+                if (parse_endpoint(replica, port, addr) == -1)
+                {
+                    std::cerr << "Invalid replica address: " << replica << std::endl;
+                    return 1;
+                }
+                config.replicas.push_back(addr);
+            }
+        }
+        
+        const char* durability_env = std::getenv("DURABILITY");
+        if (durability_env != nullptr && std::string(durability_env) == "sync")
+        {
+            config.durability = Durability::SYNC;
+        }
+        
+        // Must match the clients' VNODES so MIGRATE layouts hash keys to the same owners
+        const char* server_vnodes_env = std::getenv("VNODES");
+        if (server_vnodes_env != nullptr)
+        {
+            config.virtual_nodes = static_cast<size_t>(std::stoi(server_vnodes_env));
+        }
+        
+        // CHAIN_NEXT="ip:port" places this node in a chain ahead of that successor; the tail has none
+        const char* chain_next_env = std::getenv("CHAIN_NEXT");
+        if (chain_next_env != nullptr)
+        {
+            sockaddr_in successor{};
+            if (parse_endpoint(chain_next_env, port, successor) == -1)
+            {
+                std::cerr << "Invalid chain successor: " << chain_next_env << std::endl;
+                return 1;
+            }
+            config.replicas = {successor};
+            config.durability = Durability::SYNC;
+        }
+        
+        // SEEDS="ip:port|ip:port" joins the gossip membership through those servers (listing itself is fine);
+        // ADVERTISE is the "ip:port" the others should use for this one
+        const char* seeds_env = std::getenv("SEEDS");
+        if (seeds_env != nullptr)
+        {
+            for (const std::string& seed : parse_server_ips(seeds_env))
+            {
+                sockaddr_in addr{};
+                if (parse_endpoint(seed, port, addr) == -1)
+                {
+                    std::cerr << "Invalid seed address: " << seed << std::endl;
+                    return 1;
+                }
+                config.seeds.push_back(addr);
+            }
+        }
+        const char* advertise_env = std::getenv("ADVERTISE");
+        if (advertise_env != nullptr)
+        {
+            config.advertise = advertise_env;
+        }
+        
+        // LEASE_MS sets how long clients may cache hot keys (0 grants no leases)
+        const char* lease_env = std::getenv("LEASE_MS");
+        if (lease_env != nullptr && *lease_env != '\0')
+        {
+            config.lease_ms = static_cast<uint32_t>(std::stoul(lease_env));
+        }
+        
+        // SPREAD_RATE is the requests per second past which a hot key is copied to every member (needs SEEDS)
+        const char* spread_env = std::getenv("SPREAD_RATE");
+        if (spread_env != nullptr && *spread_env != '\0')
+        {
+            config.spread_rate = std::stoull(spread_env);
+        }
+        
+        unsigned stats_interval = 0;
+        const char* stats_env = std::getenv("STATS_INTERVAL");
+        if (stats_env != nullptr)
+        {
+            stats_interval = static_cast<unsigned>(std::stoi(stats_env));
+        }
+        
+        return run_server_mode(config, stats_interval);
     }
     else
     {
@@ -210,6 +747,91 @@ int main(int argc, char** argv)
             num_clients = static_cast<size_t>(std::stoi(num_clients_env));
         }
         
-        return run_client_mode(port, server_ips, num_clients);
+        // Binary is the default because only it carries request ids for matching replies
+        WireFormat format = WireFormat::BINARY;
+        const char* protocol_env = std::getenv("PROTOCOL");
+        if (protocol_env != nullptr && std::string(protocol_env) == "text")
+        {
+            format = WireFormat::TEXT;
+        }
+        
+        // CLIENT_MODE=async runs pipelined clients (binary protocol only) instead of closed-loop ones
+        const char* client_mode_env = std::getenv("CLIENT_MODE");
+        const bool async_mode = client_mode_env != nullptr && std::string(client_mode_env) == "async";
+        
+        size_t window = DEFAULT_ASYNC_WINDOW;
+        const char* window_env = std::getenv("WINDOW");
+        if (window_env != nullptr)
+        {
+            window = static_cast<size_t>(std::stoi(window_env));
+        }
+        
+        // Points per server on the consistent-hash ring; every client must use the same value
+        size_t virtual_nodes = HashRing::DEFAULT_VNODES;
+        const char* vnodes_env = std::getenv("VNODES");
+        if (vnodes_env != nullptr)
+        {
+            virtual_nodes = static_cast<size_t>(std::stoi(vnodes_env));
+        }
+        
+        // READ_IPS lists the tail of each chain, in the same order as the heads in SERVER_IPS
+        std::vector<std::string> read_ips;
+        const char* read_ips_env = std::getenv("READ_IPS");
+        if (read_ips_env != nullptr)
+        {
+            read_ips = parse_server_ips(read_ips_env);
+        }
+        
+        // QUORUM="N,R,W" keeps each key on N ring owners, writing to W and reading from R of them
+        std::array<size_t, 3> quorum{};
+        const char* quorum_env = std::getenv("QUORUM");
+        if (quorum_env != nullptr && *quorum_env != '\0' &&
+            std::sscanf(quorum_env, "%zu,%zu,%zu", &quorum[0], &quorum[1], &quorum[2]) != 3)
+        {
+            std::cerr << "QUORUM must be N,R,W" << std::endl;
+            return 1;
+        }
+        
+        unsigned report_interval = 0;
+        const char* report_env = std::getenv("REPORT_INTERVAL");
+        if (report_env != nullptr)
+        {
+            report_interval = static_cast<unsigned>(std::stoi(report_env));
+        }
+        
+        // MEMBERSHIP_REFRESH_MS makes clients follow the servers' gossip membership (servers need SEEDS)
+        std::chrono::milliseconds membership_refresh{0};
+        const char* refresh_env = std::getenv("MEMBERSHIP_REFRESH_MS");
+        if (refresh_env != nullptr)
+        {
+            membership_refresh = std::chrono::milliseconds(std::stoi(refresh_env));
+        }
+        
+        // HEDGE_BUDGET=0.05 lets up to 5% of quorum reads ask one extra replica when the first ones are slow
+        double hedge_budget = 0;
+        const char* hedge_env = std::getenv("HEDGE_BUDGET");
+        if (hedge_env != nullptr && *hedge_env != '\0')
+        {
+            hedge_budget = std::stod(hedge_env);
+        }
+        
+        // KEY_SKEW=0.99 draws benchmark keys from a Zipf distribution instead of uniformly
+        double key_skew = 0;
+        const char* skew_env = std::getenv("KEY_SKEW");
+        if (skew_env != nullptr && *skew_env != '\0')
+        {
+            key_skew = std::stod(skew_env);
+        }
+        
+        // NEAR_CACHE=1024 caches up to that many leased hot keys in each client
+        size_t near_cache = 0;
+        const char* near_cache_env = std::getenv("NEAR_CACHE");
+        if (near_cache_env != nullptr && *near_cache_env != '\0')
+        {
+            near_cache = std::stoul(near_cache_env);
+        }
+        
+        return run_client_mode(port, server_ips, read_ips, num_clients, format, async_mode, window, virtual_nodes,
+                               quorum, report_interval, membership_refresh, hedge_budget, key_skew, near_cache);
     }
 }
\ No newline at end of file
@@ -0,0 +1,110 @@
+#!/bin/bash
+
+# =============================================================================
+# Distributed Hash Table - Live Rebalancing Test
+# =============================================================================
+# Runs client load against INITIAL_SERVERS servers, adds ADDED_SERVERS more part way through
+# and rebalances onto them without stopping traffic. The client prints its throughput every
+# second, so the dip (if any) during the migration is visible next to the rebalance time.
+# =============================================================================
+
+set +e
+
+# Configuration
+PORT_BASE=1895
+BINARY_PATH="./build/Distibuted_Hash_Table"
+INITIAL_SERVERS=${INITIAL_SERVERS:-2}
+ADDED_SERVERS=${ADDED_SERVERS:-1}
+NUM_CLIENTS=${NUM_CLIENTS:-16}
+TEST_DURATION=${TEST_DURATION:-12}
+MIGRATE_AT=${MIGRATE_AT:-4}  # Seconds into the run
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+CYAN='\033[0;36m'
+NC='\033[0m' # No Color
+
+declare -a SERVER_PIDS
+
+log_info() {
+    echo -e "${BLUE}[INFO]${NC} $1"
+}
+
+log_error() {
+    echo -e "${RED}[ERROR]${NC} $1"
+}
+
+cleanup() {
+    for pid in "${SERVER_PIDS[@]}"; do
+        kill -9 $pid 2>/dev/null || true
+    done
+    SERVER_PIDS=()
+}
+
+trap cleanup EXIT
+
+if [ ! -f "$BINARY_PATH" ]; then
+    log_error "Binary not found at $BINARY_PATH; build it first (see benchmark_test.sh)"
+    exit 1
+fi
+
+member_list() {
+    local count=$1
+    local list=""
+    for ((i=0; i<count; i++)); do
+        if [ -n "$list" ]; then
+            list="${list}|"
+        fi
+        list="${list}127.0.0.1:$((PORT_BASE + i))"
+    done
+    echo "$list"
+}
+
+start_server() {
+    $BINARY_PATH $((PORT_BASE + $1)) > /tmp/dht_server_$1.log 2>&1 &
+    SERVER_PIDS+=($!)
+}
+
+echo -e "${CYAN}=============================================================================${NC}"
+echo -e "${CYAN}  REBALANCE: $INITIAL_SERVERS -> $((INITIAL_SERVERS + ADDED_SERVERS)) servers, $NUM_CLIENTS clients, ${TEST_DURATION}s${NC}"
+echo -e "${CYAN}=============================================================================${NC}"
+
+for ((i=0; i<INITIAL_SERVERS; i++)); do
+    start_server $i
+done
+sleep 1
+
+# Clients only know the initial servers; they learn the new ones from MOVED redirects
+log_info "Starting client load..."
+SERVER_IPS="$(member_list $INITIAL_SERVERS)" NUM_CLIENTS=$NUM_CLIENTS REPORT_INTERVAL=1 \
+    $BINARY_PATH $PORT_BASE > /tmp/dht_client.log 2>&1 &
+client_pid=$!
+
+sleep $MIGRATE_AT
+log_info "Adding $ADDED_SERVERS server(s) and rebalancing..."
+for ((i=INITIAL_SERVERS; i<INITIAL_SERVERS + ADDED_SERVERS; i++)); do
+    start_server $i
+done
+sleep 0.2
+REBALANCE="$(member_list $((INITIAL_SERVERS + ADDED_SERVERS)))" $BINARY_PATH $PORT_BASE
+
+sleep $((TEST_DURATION - MIGRATE_AT))
+kill -TERM $client_pid 2>/dev/null || true
+wait $client_pid 2>/dev/null
+
+for pid in "${SERVER_PIDS[@]}"; do
+    kill -TERM $pid 2>/dev/null || true
+done
+sleep 2
+
+echo ""
+echo -e "${GREEN}--- CLIENT RESULTS ---${NC}"
+cat /tmp/dht_client.log
+
+echo ""
+echo -e "${GREEN}--- SERVER RESULTS ---${NC}"
+for ((i=0; i<INITIAL_SERVERS + ADDED_SERVERS; i++)); do
+    echo "Server $i (port $((PORT_BASE + i))):"
+    grep -E "Executed|Migrated|Redirected" /tmp/dht_server_$i.log
+done